@@ -0,0 +1,477 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+// Microbenchmarks of the EGL/GLES primitives shctx is built on. Results are
+// written as JSON, every benchmark is repeated a fixed number of times with
+// a fixed number of iterations, so that runs on different drivers can be
+// compared directly.
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES3/gl32.h>
+
+#include <X11/Xlib.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/ctx.h"
+#include "../src/embed.h"
+#include "../src/sdr.h"
+#include "../src/shaders.h"
+#include "../src/timer.h"
+
+#define REPEAT 5
+
+struct Result {
+    const char *name;
+    const char *unit;
+    double samples[REPEAT];
+};
+
+#define MAX_RESULTS 64
+static Result results[MAX_RESULTS];
+static int num_results;
+
+static Display *xdpy;
+static EGLDisplay egl_dpy;
+static EGLSurface egl_surf;
+
+static EGL_ctx ctx_es;
+static EGL_ctx ctx_angle;
+static EGL_ctx ctx_private;
+
+static bool
+init()
+{
+    // use the same X11 platform as shctx when there's a server, otherwise
+    // anything that works without one: only pbuffers are needed
+    const char *client_exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if ((xdpy = XOpenDisplay(0))) {
+        egl_dpy = eglGetPlatformDisplay(EGL_PLATFORM_X11_EXT, (void *)xdpy, NULL);
+    } else if (client_exts && strstr(client_exts, "EGL_MESA_platform_surfaceless")) {
+        egl_dpy = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    } else {
+        egl_dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (egl_dpy == EGL_NO_DISPLAY || !eglInitialize(egl_dpy, NULL, NULL)) {
+        fprintf(stderr, "Failed to initialize EGL.\n");
+        return false;
+    }
+    eglBindAPI(EGL_OPENGL_ES_API);
+
+    EGLint attr_list[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+    EGLint num_configs;
+    if (!eglChooseConfig(egl_dpy, attr_list, &ctx_es.config, 1, &num_configs) || !num_configs) {
+        fprintf(stderr, "Failed to find a suitable EGL config.\n");
+        return false;
+    }
+    ctx_angle.config = ctx_private.config = ctx_es.config;
+
+    EGLint pbuf_atts[] = {EGL_WIDTH, 64, EGL_HEIGHT, 64, EGL_NONE};
+    if ((egl_surf = eglCreatePbufferSurface(egl_dpy, ctx_es.config, pbuf_atts)) == EGL_NO_SURFACE) {
+        fprintf(stderr, "Failed to create the pbuffer.\n");
+        return false;
+    }
+
+    EGLint ctx_atts[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
+    ctx_es.ctx = eglCreateContext(egl_dpy, ctx_es.config, EGL_NO_CONTEXT, ctx_atts);
+    ctx_angle.ctx = eglCreateContext(egl_dpy, ctx_es.config, ctx_es.ctx, ctx_atts);
+    ctx_private.ctx = eglCreateContext(egl_dpy, ctx_es.config, EGL_NO_CONTEXT, ctx_atts);
+    if (!ctx_es.ctx || !ctx_angle.ctx || !ctx_private.ctx) {
+        fprintf(stderr, "Failed to create the EGL contexts.\n");
+        return false;
+    }
+    return true;
+}
+
+static void
+cleanup()
+{
+    eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(egl_dpy, ctx_private.ctx);
+    eglDestroyContext(egl_dpy, ctx_angle.ctx);
+    eglDestroyContext(egl_dpy, ctx_es.ctx);
+    eglDestroySurface(egl_dpy, egl_surf);
+    eglTerminate(egl_dpy);
+    if (xdpy)
+        XCloseDisplay(xdpy);
+}
+
+static Result *
+add_result(const char *name, const char *unit)
+{
+    if (num_results >= MAX_RESULTS)
+        abort();
+    Result *res = results + num_results++;
+    res->name = name;
+    res->unit = unit;
+    return res;
+}
+
+static void
+make_current(EGL_ctx *ctx)
+{
+    eglMakeCurrent(egl_dpy, egl_surf, egl_surf, ctx->ctx);
+}
+
+// ---- benchmarks ----
+
+static void
+bench_make_current()
+{
+    const int iter = 2000;
+    Result *res = add_result("make_current_switch", "us");
+
+    for (int r = 0; r < REPEAT; r++) {
+        long t = get_time_usec();
+        for (int i = 0; i < iter; i++) {
+            make_current(i & 1 ? &ctx_angle : &ctx_es);
+            // a switch with no work in between can be optimized away
+            glFlush();
+        }
+        res->samples[r] = (double)(get_time_usec() - t) / iter;
+    }
+}
+
+static void
+bench_objects(EGL_ctx *ctx, const char *tex_name, const char *buf_name)
+{
+    const int iter = 500;
+    Result *tex_res = add_result(tex_name, "us");
+    Result *buf_res = add_result(buf_name, "us");
+
+    make_current(ctx);
+    for (int r = 0; r < REPEAT; r++) {
+        long t = get_time_usec();
+        for (int i = 0; i < iter; i++) {
+            GLuint tex;
+            glGenTextures(1, &tex);
+            glBindTexture(GL_TEXTURE_2D, tex);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 64, 64);
+            glDeleteTextures(1, &tex);
+        }
+        glFinish();
+        tex_res->samples[r] = (double)(get_time_usec() - t) / iter;
+
+        t = get_time_usec();
+        for (int i = 0; i < iter; i++) {
+            GLuint buf;
+            glGenBuffers(1, &buf);
+            glBindBuffer(GL_ARRAY_BUFFER, buf);
+            glBufferData(GL_ARRAY_BUFFER, 4096, 0, GL_STATIC_DRAW);
+            glDeleteBuffers(1, &buf);
+        }
+        glFinish();
+        buf_res->samples[r] = (double)(get_time_usec() - t) / iter;
+    }
+}
+
+static void
+bench_fences()
+{
+    const int iter = 500;
+    Result *same_res = add_result("fence_roundtrip_same_context", "us");
+    Result *cross_res = add_result("fence_roundtrip_cross_context", "us");
+
+    for (int r = 0; r < REPEAT; r++) {
+        make_current(&ctx_angle);
+        long t = get_time_usec();
+        for (int i = 0; i < iter; i++) {
+            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+        }
+        same_res->samples[r] = (double)(get_time_usec() - t) / iter;
+
+        // producer fences, consumer waits: includes the context switches
+        t = get_time_usec();
+        for (int i = 0; i < iter; i++) {
+            make_current(&ctx_angle);
+            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+            make_current(&ctx_es);
+            glClientWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+        }
+        cross_res->samples[r] = (double)(get_time_usec() - t) / iter;
+    }
+}
+
+static void
+bench_tex_upload()
+{
+    static const int sizes[] = {64, 256, 1024, 2048, 4096};
+    static const char *names[] = {
+        "tex_sub_image_64", "tex_sub_image_256", "tex_sub_image_1024",
+        "tex_sub_image_2048", "tex_sub_image_4096"
+    };
+    const long bytes_per_rep = 64L << 20;
+
+    make_current(&ctx_angle);
+    unsigned char *pixels = (unsigned char *)malloc(4096 * 4096 * 4);
+    if (!pixels)
+        return;
+    for (long i = 0; i < 4096 * 4096 * 4; i++) {
+        pixels[i] = i * 7;
+    }
+
+    for (unsigned int s = 0; s < sizeof sizes / sizeof *sizes; s++) {
+        int sz = sizes[s];
+        long bytes = (long)sz * sz * 4;
+        int iter = bytes_per_rep / bytes > 0 ? bytes_per_rep / bytes : 1;
+        Result *res = add_result(names[s], "MB/s");
+
+        GLuint tex;
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, sz, sz);
+        // first upload allocates on some drivers, keep it out of the numbers
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, sz, sz, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glFinish();
+
+        for (int r = 0; r < REPEAT; r++) {
+            long t = get_time_usec();
+            for (int i = 0; i < iter; i++) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, sz, sz, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+            }
+            glFinish();
+            long usec = get_time_usec() - t;
+            res->samples[r] = usec > 0 ? (double)bytes * iter / usec : 0;
+        }
+        glDeleteTextures(1, &tex);
+    }
+    free(pixels);
+}
+
+static void
+bench_shaders()
+{
+    const int iter = 20;
+    Result *comp_res = add_result("create_shader", "ms");
+    Result *link_res = add_result("link_program", "ms");
+
+    make_current(&ctx_angle);
+    for (int r = 0; r < REPEAT; r++) {
+        long comp_usec = 0, link_usec = 0;
+
+        for (int i = 0; i < iter; i++) {
+            // vary the source, so that no shader cache can hit
+            char defs[32];
+            snprintf(defs, sizeof defs, "BENCH_ITER=%d", r * iter + i);
+
+            long t = get_time_usec();
+            unsigned int vs = create_shader_defs(shaders::texmap_vert.src, GL_VERTEX_SHADER, defs);
+            unsigned int fs = create_shader_defs(shaders::texmap_frag.src, GL_FRAGMENT_SHADER, defs);
+            glFinish();
+            comp_usec += get_time_usec() - t;
+
+            t = get_time_usec();
+            unsigned int prog = create_program();
+            attach_shader(prog, vs);
+            attach_shader(prog, fs);
+            link_program(prog);
+            glFinish();
+            link_usec += get_time_usec() - t;
+
+            free_program(prog);
+            free_shader(vs);
+            free_shader(fs);
+        }
+        // two shaders per iteration
+        comp_res->samples[r] = comp_usec / 1000.0 / (iter * 2);
+        link_res->samples[r] = link_usec / 1000.0 / iter;
+    }
+}
+
+// the texmap program as shctx creates it, from the embedded sources: after
+// the first one, this is what a driver shader cache makes of startup
+static void
+bench_embedded_program()
+{
+    const int iter = 20;
+    Result *res = add_result("create_program_embedded", "ms");
+
+    make_current(&ctx_angle);
+    for (int r = 0; r < REPEAT; r++) {
+        long t = get_time_usec();
+        for (int i = 0; i < iter; i++) {
+            unsigned int prog = create_program_embedded(shaders::texmap_vert, shaders::texmap_frag);
+            glFinish();
+            free_program(prog);
+        }
+        res->samples[r] = (get_time_usec() - t) / 1000.0 / iter;
+    }
+}
+
+// a new vertex/fragment combination: one pipeline, from stage programs that
+// are already linked, against a link of both stages above
+static void
+bench_pipelines()
+{
+    const int iter = 20;
+    Result *stage_res = add_result("link_stage_program", "ms");
+    Result *pipe_res = add_result("pipeline_new_combination", "us");
+
+    make_current(&ctx_angle);
+    for (int r = 0; r < REPEAT; r++) {
+        long stage_usec = 0, pipe_usec = 0;
+
+        for (int i = 0; i < iter; i++) {
+            char defs[32];
+            snprintf(defs, sizeof defs, "BENCH_PIPE=%d", r * iter + i);
+            unsigned int vs = create_shader_defs(shaders::texmap_vert.src, GL_VERTEX_SHADER, defs);
+            unsigned int fs = create_shader_defs(shaders::texmap_frag.src, GL_FRAGMENT_SHADER, defs);
+
+            long t = get_time_usec();
+            unsigned int vprog = create_stage_program(vs);
+            unsigned int fprog = create_stage_program(fs);
+            glFinish();
+            stage_usec += get_time_usec() - t;
+
+            t = get_time_usec();
+            bind_program_pipeline(get_program_pipeline(ctx_angle.ctx, vprog, fprog));
+            glFinish();
+            pipe_usec += get_time_usec() - t;
+
+            bind_program_pipeline(0);
+            free_program_pipelines(ctx_angle.ctx);
+            free_program(vprog);
+            free_program(fprog);
+            free_shader(vs);
+            free_shader(fs);
+        }
+        stage_res->samples[r] = stage_usec / 1000.0 / (iter * 2);
+        pipe_res->samples[r] = (double)pipe_usec / iter;
+    }
+}
+
+// ---- output ----
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+static void
+json_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; s && *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', fp);
+        if ((unsigned char)*s >= 0x20)
+            fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+static void
+write_json(FILE *fp)
+{
+    make_current(&ctx_es);
+
+    fprintf(fp, "{\n  \"environment\": {\n");
+    fprintf(fp, "    \"egl_vendor\": ");
+    json_string(fp, eglQueryString(egl_dpy, EGL_VENDOR));
+    fprintf(fp, ",\n    \"egl_version\": ");
+    json_string(fp, eglQueryString(egl_dpy, EGL_VERSION));
+    fprintf(fp, ",\n    \"gl_vendor\": ");
+    json_string(fp, (const char *)glGetString(GL_VENDOR));
+    fprintf(fp, ",\n    \"gl_renderer\": ");
+    json_string(fp, (const char *)glGetString(GL_RENDERER));
+    fprintf(fp, ",\n    \"gl_version\": ");
+    json_string(fp, (const char *)glGetString(GL_VERSION));
+    fprintf(fp, ",\n    \"repeat\": %d\n  },\n", REPEAT);
+
+    fprintf(fp, "  \"results\": [\n");
+    for (int i = 0; i < num_results; i++) {
+        Result *res = results + i;
+        double sorted[REPEAT], sum = 0;
+
+        memcpy(sorted, res->samples, sizeof sorted);
+        qsort(sorted, REPEAT, sizeof *sorted, cmp_double);
+        for (int r = 0; r < REPEAT; r++) {
+            sum += sorted[r];
+        }
+
+        fprintf(fp, "    {\"name\": \"%s\", \"unit\": \"%s\", \"min\": %.4f, \"median\": %.4f, "
+                "\"mean\": %.4f, \"max\": %.4f}%s\n", res->name, res->unit, sorted[0],
+                sorted[REPEAT / 2], sum / REPEAT, sorted[REPEAT - 1],
+                i < num_results - 1 ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *outfile = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outfile = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [-o <output json>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (!init())
+        return 1;
+
+    bench_make_current();
+    bench_objects(&ctx_angle, "texture_create_delete_shared", "buffer_create_delete_shared");
+    bench_objects(&ctx_private, "texture_create_delete_private", "buffer_create_delete_private");
+    bench_fences();
+    bench_tex_upload();
+    bench_shaders();
+    bench_embedded_program();
+    bench_pipelines();
+
+    FILE *fp = outfile ? fopen(outfile, "w") : stdout;
+    if (!fp) {
+        fprintf(stderr, "Failed to open %s for writing.\n", outfile);
+        cleanup();
+        return 1;
+    }
+    write_json(fp);
+    if (fp != stdout)
+        fclose(fp);
+
+    cleanup();
+    return 0;
+}
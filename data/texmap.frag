@@ -6,5 +6,10 @@ uniform sampler2D tex;
 
 void main()
 {
+#ifdef OPAQUE
+	// the surface has alpha: keep the window from turning translucent
+	fcolor = vec4(texture(tex, uvc).rgb, 1.0);
+#else
 	fcolor = texture(tex, uvc);
+#endif
 }
@@ -0,0 +1,110 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+
+#include "cmdqueue.h"
+
+bool
+cmdq_init(CommandQueue *q)
+{
+    q->head.store(0);
+    q->tail.store(0);
+    return sem_init(&q->avail, 0, 0) == 0;
+}
+
+void
+cmdq_destroy(CommandQueue *q)
+{
+    sem_destroy(&q->avail);
+}
+
+void
+cmdq_push(CommandQueue *q, const Command &cmd)
+{
+    unsigned int tail = q->tail.load(std::memory_order_relaxed);
+
+    // the consumer drains everything on each wake up, so this only
+    // happens if it's stuck, and dropping a quit isn't an option
+    while (tail - q->head.load(std::memory_order_acquire) == CMD_QUEUE_SIZE) {
+        sched_yield();
+    }
+
+    q->cmds[tail % CMD_QUEUE_SIZE] = cmd;
+    q->tail.store(tail + 1, std::memory_order_release);
+    sem_post(&q->avail);
+}
+
+// One post per command, but the consumer pops them all at once. Drop the
+// posts of the commands that are already in the queue, those pushed after
+// this still wake up the next wait.
+static void
+drop_wakeups(CommandQueue *q)
+{
+    while (sem_trywait(&q->avail) == 0) {
+    }
+}
+
+void
+cmdq_wait(CommandQueue *q)
+{
+    while (sem_wait(&q->avail) != 0) {
+        // interrupted, try again
+    }
+    drop_wakeups(q);
+}
+
+bool
+cmdq_wait_usec(CommandQueue *q, long usec)
+{
+    // sem_timedwait only takes the realtime clock
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    long nsec = ts.tv_nsec + (usec % 1000000) * 1000;
+    ts.tv_sec += usec / 1000000 + nsec / 1000000000;
+    ts.tv_nsec = nsec % 1000000000;
+
+    while (sem_timedwait(&q->avail, &ts) != 0) {
+        if (errno != EINTR)
+            return false;
+    }
+    drop_wakeups(q);
+    return true;
+}
+
+bool
+cmdq_pop(CommandQueue *q, Command *cmd)
+{
+    unsigned int head = q->head.load(std::memory_order_relaxed);
+    if (head == q->tail.load(std::memory_order_acquire))
+        return false;
+
+    *cmd = q->cmds[head % CMD_QUEUE_SIZE];
+    q->head.store(head + 1, std::memory_order_release);
+    return true;
+}
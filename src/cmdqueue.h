@@ -0,0 +1,73 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#ifndef CMDQUEUE_H
+#define CMDQUEUE_H
+
+#include <atomic>
+#include <semaphore.h>
+
+#include "damage.h"
+
+enum {
+    CMD_REDRAW,     // rect: exposed area, in X coordinates
+    CMD_RESIZE,     // rect: new size of the output
+    CMD_MAP,        // rect.width: non zero if the output got mapped
+    CMD_QUIT
+};
+
+struct Command {
+    int type;
+    int output;
+    Rect rect;
+};
+
+// Single producer, single consumer ring of commands. Pushing and popping
+// never take a lock: the producer only writes tail and the consumer only
+// writes head. The semaphore lets the consumer sleep while it's empty.
+#define CMD_QUEUE_SIZE 256
+
+struct CommandQueue {
+    Command cmds[CMD_QUEUE_SIZE];
+    std::atomic<unsigned int> head;
+    std::atomic<unsigned int> tail;
+    sem_t avail;
+};
+
+bool cmdq_init(CommandQueue *q);
+void cmdq_destroy(CommandQueue *q);
+
+// producer side, waits for the consumer if the queue is full
+void cmdq_push(CommandQueue *q, const Command &cmd);
+
+// consumer side: cmdq_wait blocks until commands were pushed, cmdq_pop
+// returns false once the queue is empty
+void cmdq_wait(CommandQueue *q);
+// waits for at most usec, false if nothing was pushed meanwhile
+bool cmdq_wait_usec(CommandQueue *q, long usec);
+bool cmdq_pop(CommandQueue *q, Command *cmd);
+
+#endif //CMDQUEUE_H
@@ -29,10 +29,44 @@
 
 #include <EGL/egl.h>
 #include <X11/Xlib.h>
+#include <pthread.h>
+
+#include "damage.h"
+
+struct RenderTarget;
 
 struct EGL_ctx {
     EGLContext ctx;
     EGLConfig config;
 };
 
+// One presentation target of the shared texture: an X window, or a pbuffer
+// when running headless. In threaded presentation each output has its own
+// context (shared with ctx_es) and thread, otherwise ctx is ctx_es.
+struct Output {
+    Window win;
+    EGLSurface surf;
+    EGL_ctx ctx;
+    int width, height;
+    bool mapped;
+
+    char name[24];
+    pthread_t tid;
+    int frame;
+
+    // pending damage, in window and in shared texture coordinates
+    Rect damage;
+    Rect tex_damage;
+    DamageHistory damage_hist;
+
+    // intermediate target the output is rendered to, with -fbo
+    RenderTarget *rt;
+
+    // presentation cost (draw + swap) of this output
+    long present_usec;
+    int present_count;
+    int partial_count;
+    int skip_count;
+};
+
 #endif //CTX_H
@@ -0,0 +1,112 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#include "damage.h"
+
+bool
+rect_empty(const Rect &r)
+{
+    return r.width <= 0 || r.height <= 0;
+}
+
+Rect
+rect_union(const Rect &a, const Rect &b)
+{
+    if (rect_empty(a))
+        return b;
+    if (rect_empty(b))
+        return a;
+
+    int x0 = a.x < b.x ? a.x : b.x;
+    int y0 = a.y < b.y ? a.y : b.y;
+    int x1 = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+    int y1 = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+
+    Rect res = {x0, y0, x1 - x0, y1 - y0};
+    return res;
+}
+
+Rect
+rect_intersect(const Rect &a, const Rect &b)
+{
+    int x0 = a.x > b.x ? a.x : b.x;
+    int y0 = a.y > b.y ? a.y : b.y;
+    int x1 = a.x + a.width < b.x + b.width ? a.x + a.width : b.x + b.width;
+    int y1 = a.y + a.height < b.y + b.height ? a.y + a.height : b.y + b.height;
+
+    Rect res = {0, 0, 0, 0};
+    if (x1 > x0 && y1 > y0) {
+        res.x = x0;
+        res.y = y0;
+        res.width = x1 - x0;
+        res.height = y1 - y0;
+    }
+    return res;
+}
+
+Rect
+rect_scale(const Rect &r, int from_w, int from_h, int to_w, int to_h)
+{
+    Rect res = {0, 0, 0, 0};
+    if (rect_empty(r) || from_w <= 0 || from_h <= 0)
+        return res;
+
+    int x0 = (long)r.x * to_w / from_w;
+    int y0 = (long)r.y * to_h / from_h;
+    int x1 = ((long)(r.x + r.width) * to_w + from_w - 1) / from_w;
+    int y1 = ((long)(r.y + r.height) * to_h + from_h - 1) / from_h;
+
+    res.x = x0;
+    res.y = y0;
+    res.width = x1 - x0;
+    res.height = y1 - y0;
+    return res;
+}
+
+void
+damage_push(DamageHistory *hist, const Rect &r)
+{
+    for (int i = MAX_BUFFER_AGE - 1; i > 0; i--) {
+        hist->rects[i] = hist->rects[i - 1];
+    }
+    hist->rects[0] = r;
+    if (hist->count < MAX_BUFFER_AGE)
+        hist->count++;
+}
+
+Rect
+damage_for_age(const DamageHistory *hist, const Rect &r, int age, const Rect &full)
+{
+    // age 0 means undefined contents, and we don't remember older frames
+    if (age <= 0 || age - 1 > hist->count)
+        return full;
+
+    Rect res = r;
+    for (int i = 0; i < age - 1; i++) {
+        res = rect_union(res, hist->rects[i]);
+    }
+    return rect_intersect(res, full);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+// Rectangles in GL window coordinates (origin at the bottom-left), which is
+// also what EGL_KHR_swap_buffers_with_damage and EGL_KHR_partial_update use.
+struct Rect {
+    int x, y;
+    int width, height;
+};
+
+bool rect_empty(const Rect &r);
+// bounding box of both rectangles, empty rectangles are ignored
+Rect rect_union(const Rect &a, const Rect &b);
+Rect rect_intersect(const Rect &a, const Rect &b);
+// maps a rectangle of a from_w x from_h area to a to_w x to_h area, rounding
+// outwards so that the result covers every pixel the source touches
+Rect rect_scale(const Rect &r, int from_w, int from_h, int to_w, int to_h);
+
+// Damage of the last frames presented to a surface. With a buffer age of n
+// the back buffer misses the damage of the last n - 1 frames.
+#define MAX_BUFFER_AGE 4
+
+struct DamageHistory {
+    Rect rects[MAX_BUFFER_AGE];
+    int count;
+};
+
+void damage_push(DamageHistory *hist, const Rect &r);
+// area to repaint when the back buffer has the given age
+Rect damage_for_age(const DamageHistory *hist, const Rect &r, int age, const Rect &full);
+
+#endif //DAMAGE_H
@@ -0,0 +1,71 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#include "embed.h"
+#include "sdr.h"
+
+unsigned int
+create_program_embedded(const EmbeddedShader &vs, const EmbeddedShader &ps)
+{
+    unsigned int vsdr, psdr, prog = 0;
+
+    if (!(vsdr = create_shader(vs.src, vs.type)))
+        return 0;
+    if ((psdr = create_shader(ps.src, ps.type))) {
+        prog = create_program_link(vsdr, psdr, 0);
+        free_shader(psdr);
+    }
+    // the program keeps them until it's deleted
+    free_shader(vsdr);
+    return prog;
+}
+
+unsigned int
+create_compute_program_embedded(const EmbeddedShader &cs)
+{
+    unsigned int sdr, prog;
+
+    if (!(sdr = create_shader(cs.src, cs.type)))
+        return 0;
+    prog = create_program_link(sdr, 0);
+    free_shader(sdr);
+    return prog;
+}
+
+unsigned int
+get_program_variant_embedded(const EmbeddedShader &vs, const EmbeddedShader &ps,
+        const char *defs)
+{
+    return get_program_variant_src(vs.src, ps.src, defs);
+}
+
+void
+get_uniform_locations(unsigned int prog, const char *const *names, int count, int *loc)
+{
+    for (int i = 0; i < count; i++) {
+        loc[i] = glGetUniformLocation(prog, names[i]);
+    }
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#ifndef EMBED_H
+#define EMBED_H
+
+#include <GLES3/gl32.h>
+
+// Shaders embedded in the binary at build time, see src/shaders.h, which
+// tools/embed_shaders.awk generates from data/.
+struct EmbeddedShader {
+    const char *name;       // the file it was embedded from
+    unsigned int type;      // GL_VERTEX_SHADER, ...
+    const char *src;
+};
+
+unsigned int create_program_embedded(const EmbeddedShader &vs, const EmbeddedShader &ps);
+unsigned int create_compute_program_embedded(const EmbeddedShader &cs);
+
+// a program variant of embedded shaders, from the cache in sdr.c: see
+// get_program_variant_src. it's freed with free_program_variants
+unsigned int get_program_variant_embedded(const EmbeddedShader &vs, const EmbeddedShader &ps,
+        const char *defs);
+
+// GLSL types of the uniform handles, other than the C++ ones
+struct Vec2;
+struct Vec3;
+struct Vec4;
+struct Mat3;
+struct Mat4;
+struct Sampler;
+struct Image;   // set with a layout binding, there's no setter
+
+// A uniform, by its slot in the uniform tables, and the type it's declared
+// with. Setting it with the wrong type doesn't compile.
+template <typename T>
+struct UniformSlot {
+    int slot;
+};
+
+// The locations of all the uniform slots in one program, looked up once
+// after linking. Slots the program doesn't use are -1, which GL ignores.
+//
+// The slots are global: one table has every uniform declared in any of the
+// embedded shaders, not only those of its program. The types are checked,
+// but setting a uniform of another program compiles, and does nothing.
+template <int N>
+struct UniformTable {
+    int loc[N > 0 ? N : 1];
+};
+
+void get_uniform_locations(unsigned int prog, const char *const *names, int count, int *loc);
+
+// set the uniform of the program in use
+template <int N>
+inline void
+set_uniform(const UniformTable<N> &uni, UniformSlot<int> u, int val)
+{
+    glUniform1i(uni.loc[u.slot], val);
+}
+
+template <int N>
+inline void
+set_uniform(const UniformTable<N> &uni, UniformSlot<unsigned int> u, unsigned int val)
+{
+    glUniform1ui(uni.loc[u.slot], val);
+}
+
+template <int N>
+inline void
+set_uniform(const UniformTable<N> &uni, UniformSlot<float> u, float val)
+{
+    glUniform1f(uni.loc[u.slot], val);
+}
+
+template <int N>
+inline void
+set_uniform(const UniformTable<N> &uni, UniformSlot<Vec2> u, float x, float y)
+{
+    glUniform2f(uni.loc[u.slot], x, y);
+}
+
+template <int N>
+inline void
+set_uniform(const UniformTable<N> &uni, UniformSlot<Vec3> u, float x, float y, float z)
+{
+    glUniform3f(uni.loc[u.slot], x, y, z);
+}
+
+template <int N>
+inline void
+set_uniform(const UniformTable<N> &uni, UniformSlot<Vec4> u, float x, float y, float z, float w)
+{
+    glUniform4f(uni.loc[u.slot], x, y, z, w);
+}
+
+template <int N>
+inline void
+set_uniform(const UniformTable<N> &uni, UniformSlot<Mat3> u, const float *mat)
+{
+    glUniformMatrix3fv(uni.loc[u.slot], 1, GL_FALSE, mat);
+}
+
+template <int N>
+inline void
+set_uniform(const UniformTable<N> &uni, UniformSlot<Mat4> u, const float *mat)
+{
+    glUniformMatrix4fv(uni.loc[u.slot], 1, GL_FALSE, mat);
+}
+
+// the texture unit of a sampler
+template <int N>
+inline void
+set_uniform(const UniformTable<N> &uni, UniformSlot<Sampler> u, int unit)
+{
+    glUniform1i(uni.loc[u.slot], unit);
+}
+
+#endif //EMBED_H
@@ -0,0 +1,429 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_PNG
+#include <png.h>
+#endif
+
+#include "ingest.h"
+#include "timer.h"
+
+// ---- netpbm ----
+
+struct Parser {
+    const unsigned char *ptr, *end;
+};
+
+static void
+skip_space(Parser *p)
+{
+    while (p->ptr < p->end) {
+        if (*p->ptr == '#') {
+            while (p->ptr < p->end && *p->ptr != '\n')
+                p->ptr++;
+        } else if (isspace(*p->ptr)) {
+            p->ptr++;
+        } else {
+            break;
+        }
+    }
+}
+
+static bool
+read_int(Parser *p, int *val)
+{
+    skip_space(p);
+    if (p->ptr == p->end || !isdigit(*p->ptr))
+        return false;
+
+    long v = 0;
+    while (p->ptr < p->end && isdigit(*p->ptr)) {
+        v = v * 10 + *p->ptr++ - '0';
+        if (v > 65535)
+            return false;
+    }
+    *val = v;
+    return true;
+}
+
+static bool
+read_word(Parser *p, char *buf, int size)
+{
+    skip_space(p);
+    int len = 0;
+    while (p->ptr < p->end && !isspace(*p->ptr)) {
+        if (len < size - 1)
+            buf[len++] = *p->ptr;
+        p->ptr++;
+    }
+    buf[len] = 0;
+    return len > 0;
+}
+
+// P5 (PGM), P6 (PPM): magic, width, height, maxval, one whitespace
+static bool
+parse_pnm(ImageFile *img, Parser *p, int channels)
+{
+    img->channels = channels;
+    if (!read_int(p, &img->width) || !read_int(p, &img->height) ||
+            !read_int(p, &img->maxval))
+        return false;
+    if (p->ptr == p->end || !isspace(*p->ptr))
+        return false;
+    p->ptr++;
+    return true;
+}
+
+// P7 (PAM): lines of "TOKEN value" up to ENDHDR
+static bool
+parse_pam(ImageFile *img, Parser *p)
+{
+    char tok[32];
+    img->width = img->height = img->channels = img->maxval = 0;
+
+    for (;;) {
+        if (!read_word(p, tok, sizeof tok))
+            return false;
+        if (strcmp(tok, "ENDHDR") == 0) {
+            break;
+        } else if (strcmp(tok, "WIDTH") == 0) {
+            if (!read_int(p, &img->width))
+                return false;
+        } else if (strcmp(tok, "HEIGHT") == 0) {
+            if (!read_int(p, &img->height))
+                return false;
+        } else if (strcmp(tok, "DEPTH") == 0) {
+            if (!read_int(p, &img->channels))
+                return false;
+        } else if (strcmp(tok, "MAXVAL") == 0) {
+            if (!read_int(p, &img->maxval))
+                return false;
+        } else {
+            // TUPLTYPE, the depth says enough
+            while (p->ptr < p->end && *p->ptr != '\n')
+                p->ptr++;
+        }
+    }
+    while (p->ptr < p->end && *p->ptr != '\n')
+        p->ptr++;
+    if (p->ptr == p->end)
+        return false;
+    p->ptr++;
+    return img->channels >= 1 && img->channels <= 4;
+}
+
+static bool
+open_pnm(ImageFile *img)
+{
+    Parser p = {img->data + 2, img->data + img->size};
+    bool res;
+
+    switch (img->data[1]) {
+    case '5':
+        res = parse_pnm(img, &p, 1);
+        break;
+    case '6':
+        res = parse_pnm(img, &p, 3);
+        break;
+    case '7':
+        res = parse_pam(img, &p);
+        break;
+    default:
+        return false;
+    }
+    if (!res || img->width <= 0 || img->height <= 0 || img->maxval <= 0)
+        return false;
+
+    img->offset = p.ptr - img->data;
+    size_t bpp = img->channels * (img->maxval > 255 ? 2 : 1);
+    return img->size - img->offset >= (size_t)img->width * img->height * bpp;
+}
+
+static bool
+decode_pnm(const ImageFile *img, unsigned char *dst)
+{
+    const unsigned char *src = img->data + img->offset;
+    bool wide = img->maxval > 255;
+    long row_size = (long)img->width * 4;
+
+    for (int y = 0; y < img->height; y++) {
+        unsigned char *dptr = dst + (img->height - 1 - y) * row_size;
+
+        for (int x = 0; x < img->width; x++) {
+            int s[4];
+            for (int c = 0; c < img->channels; c++) {
+                int v = wide ? (src[0] << 8 | src[1]) : src[0];
+                src += wide ? 2 : 1;
+                s[c] = img->maxval == 255 ? v : v * 255 / img->maxval;
+            }
+
+            switch (img->channels) {
+            case 1:
+            case 2:
+                dptr[0] = dptr[1] = dptr[2] = s[0];
+                dptr[3] = img->channels == 2 ? s[1] : 255;
+                break;
+            default:
+                dptr[0] = s[0];
+                dptr[1] = s[1];
+                dptr[2] = s[2];
+                dptr[3] = img->channels == 4 ? s[3] : 255;
+                break;
+            }
+            dptr += 4;
+        }
+    }
+    return true;
+}
+
+// ---- PNG ----
+
+static const unsigned char png_sig[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+#ifdef HAVE_PNG
+// the size is in the IHDR chunk, which comes first
+static bool
+open_png(ImageFile *img)
+{
+    if (img->size < 24 || memcmp(img->data + 12, "IHDR", 4) != 0)
+        return false;
+
+    const unsigned char *p = img->data + 16;
+    img->width = p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+    img->height = p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7];
+    return img->width > 0 && img->height > 0;
+}
+
+static bool
+decode_png(const ImageFile *img, unsigned char *dst)
+{
+    png_image png;
+    memset(&png, 0, sizeof png);
+    png.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_memory(&png, img->data, img->size))
+        return false;
+    png.format = PNG_FORMAT_RGBA;
+
+    // a negative stride writes the rows bottom-up
+    int stride = -(int)PNG_IMAGE_ROW_STRIDE(png);
+    if (!png_image_finish_read(&png, 0, dst, stride, 0)) {
+        png_image_free(&png);
+        return false;
+    }
+    return true;
+}
+#endif // HAVE_PNG
+
+// ---- files ----
+
+bool
+image_open(ImageFile *img, const char *path)
+{
+    memset(img, 0, sizeof *img);
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Failed to open image: %s.\n", path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < 8) {
+        fprintf(stderr, "Invalid image: %s.\n", path);
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Failed to map image: %s.\n", path);
+        return false;
+    }
+    img->data = (const unsigned char *)data;
+    img->size = st.st_size;
+
+    bool res = false;
+    if (img->data[0] == 'P') {
+        img->type = IMAGE_PNM;
+        res = open_pnm(img);
+    } else if (memcmp(img->data, png_sig, sizeof png_sig) == 0) {
+        img->type = IMAGE_PNG;
+#ifdef HAVE_PNG
+        res = open_png(img);
+#else
+        fprintf(stderr, "No PNG support: %s.\n", path);
+        image_close(img);
+        return false;
+#endif
+    }
+
+    if (!res) {
+        fprintf(stderr, "Unsupported or invalid image: %s.\n", path);
+        image_close(img);
+        return false;
+    }
+
+    // decoded sequentially by one of the workers
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    return true;
+}
+
+void
+image_close(ImageFile *img)
+{
+    if (img->data)
+        munmap((void *)img->data, img->size);
+    img->data = 0;
+}
+
+bool
+image_decode(const ImageFile *img, unsigned char *dst)
+{
+    switch (img->type) {
+    case IMAGE_PNM:
+        return decode_pnm(img, dst);
+#ifdef HAVE_PNG
+    case IMAGE_PNG:
+        return decode_png(img, dst);
+#endif
+    default:
+        break;
+    }
+    return false;
+}
+
+// ---- decode pool ----
+
+static void *
+decode_thread(void *arg)
+{
+    DecodePool *pool = (DecodePool *)arg;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->head && !pool->quit)
+            pthread_cond_wait(&pool->work_cond, &pool->mutex);
+        if (pool->quit)
+            break;
+
+        DecodeJob *job = pool->head;
+        if (!(pool->head = job->next))
+            pool->tail = 0;
+        pthread_mutex_unlock(&pool->mutex);
+
+        job->start_usec = get_time_usec();
+        bool ok = image_decode(job->img, job->dst);
+        job->end_usec = get_time_usec();
+
+        pthread_mutex_lock(&pool->mutex);
+        job->ok = ok;
+        job->done = true;
+        pthread_cond_broadcast(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
+
+bool
+decode_pool_init(DecodePool *pool, int num_threads)
+{
+    memset(pool, 0, sizeof *pool);
+    pthread_mutex_init(&pool->mutex, 0);
+    pthread_cond_init(&pool->work_cond, 0);
+    pthread_cond_init(&pool->done_cond, 0);
+
+    if (!(pool->threads = (pthread_t *)malloc(num_threads * sizeof *pool->threads)))
+        return false;
+
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(pool->threads + i, 0, decode_thread, pool) != 0) {
+            fprintf(stderr, "Failed to start decode thread %d.\n", i);
+            decode_pool_destroy(pool);
+            return false;
+        }
+        pool->num_threads++;
+    }
+    return true;
+}
+
+void
+decode_pool_destroy(DecodePool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], 0);
+    }
+    free(pool->threads);
+    pool->threads = 0;
+    pool->num_threads = 0;
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->mutex);
+}
+
+void
+decode_submit(DecodePool *pool, DecodeJob *job)
+{
+    job->done = job->ok = false;
+    job->next = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->tail) {
+        pool->tail->next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+bool
+decode_wait(DecodePool *pool, DecodeJob *job)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while (!job->done)
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    bool ok = job->ok;
+    pthread_mutex_unlock(&pool->mutex);
+    return ok;
+}
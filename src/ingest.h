@@ -0,0 +1,91 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Image files, memory mapped, decoded to RGBA8 with the bottom row first,
+// as GL expects it. Netpbm (PPM/PGM binary, PAM) is always supported, PNG
+// when built with libpng (HAVE_PNG).
+enum {
+    IMAGE_PNM,
+    IMAGE_PNG
+};
+
+struct ImageFile {
+    const unsigned char *data;
+    size_t size;
+
+    int type;
+    int width, height;
+
+    // netpbm samples
+    int channels;
+    int maxval;
+    size_t offset;
+};
+
+// maps the file and reads its header, the pixels are decoded later
+bool image_open(ImageFile *img, const char *path);
+void image_close(ImageFile *img);
+// writes width x height RGBA8 pixels to dst
+bool image_decode(const ImageFile *img, unsigned char *dst);
+
+// Decodes images on a pool of worker threads, in whatever order the
+// workers get to them. Jobs are owned by the caller.
+struct DecodeJob {
+    const ImageFile *img;
+    unsigned char *dst;
+
+    bool done;
+    bool ok;
+    long start_usec, end_usec;
+
+    DecodeJob *next;
+};
+
+struct DecodePool {
+    pthread_t *threads;
+    int num_threads;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    DecodeJob *head, *tail;
+    bool quit;
+};
+
+bool decode_pool_init(DecodePool *pool, int num_threads);
+void decode_pool_destroy(DecodePool *pool);
+
+void decode_submit(DecodePool *pool, DecodeJob *job);
+// blocks until the job is done, returns whether it decoded successfully
+bool decode_wait(DecodePool *pool, DecodeJob *job);
+
+#endif //INGEST_H
@@ -30,134 +30,575 @@
 
 #include <X11/Xlib.h>
 
+#include <dirent.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "cmdqueue.h"
 #include "ctx.h"
+#include "embed.h"
+#include "ingest.h"
+#include "memacct.h"
+#include "pacing.h"
+#include "rtpool.h"
 #include "sdr.h"
+#include "shaders.h"
+#include "texpool.h"
+#include "timer.h"
+#include "trace.h"
+#include "upload.h"
+#include "warmup.h"
 
 // functions
+static bool parse_args(int argc, char **argv);
+static bool replay();
 static bool init();
 static void cleanup();
 
 static EGLConfig egl_choose_config();
 static bool egl_init();
+static void egl_init_ext();
 static bool egl_create_context(EGL_ctx *ctx, EGLContext shared);
+static GLenum egl_config_format(EGLConfig config);
 
 static Window x_create_window(int vis_id, int win_w, int win_h);
 static bool handle_xevent(XEvent *ev);
+static void flush_xevents();
+static Output *find_output(Window win);
 
 static bool gl_init();
 static void gl_cleanup();
 
-static void display();
-static void reshape(int w, int h);
+static void gen_xor_cpu(PooledTexture *ptex, int offset);
+static unsigned char *gen_xor_image(int size);
+static bool upload_frame();
+static bool gen_xor_compute(PooledTexture *ptex, unsigned int prog,
+        const shaders::Uniforms &uni, int offset);
+
+static bool gl_init_start();
+static bool gl_init_wait();
+static void *gl_init_thread(void *);
+
+static void add_phase(const char *name, long start);
+static void print_phases();
+
+static bool present_start();
+static void present_stop();
+static void present_all();
+static void *present_thread(void *arg);
+static void print_present_stats();
+
+static bool render_start();
+static void render_stop();
+static void *render_thread(void *);
+struct ContentFrame;
+
+static bool render_commands(bool paced);
+static bool render_paced();
+
+static bool producer_start();
+static void producer_stop();
+static void *producer_thread(void *);
+static bool latch_frame();
+static void publish_frame(ContentFrame frame);
+
+static bool list_images(const char *path);
+static void *ingest_thread(void *);
+static bool ingest_finished();
+static void print_ingest_stats();
+static void post_command(int type, Output *out, const Rect &r);
+
+static void damage_output(Output *out, const Rect &r);
+static void damage_texture(const Rect &r);
+static void damage_all();
+
+static long egl_surface_size(int w, int h, bool window);
+static void over_budget(long used, long budget, void *cls);
+
+static void display(Output *out);
+static void reshape(Output *out, int w, int h);
 static bool keyboard(KeySym sym);
 
 // variables
 static EGLDisplay egl_dpy;
-static EGLSurface egl_surf;
+
+static PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC egl_swap_buffers_with_damage;
+static PFNEGLSETDAMAGEREGIONKHRPROC egl_set_damage_region;
+static bool egl_buffer_age;
+static bool egl_khr_create_context;
 
 static EGL_ctx ctx_es;
 static EGL_ctx ctx_angle;
 
-static GLuint gl_tex;
+static PooledTexture *gl_tex;
 static unsigned int gl_prog;
-static GLuint gl_fbo;
-static GLuint gl_rbo;
+static shaders::Uniforms gl_prog_uniforms;
 static GLuint gl_vbo;
+static int tex_width, tex_height;
 
 static int xscr;
 static Display *xdpy;
 static Window xroot;
-static Window win;
 static Atom xa_wm_proto;
 static Atom xa_wm_del_win;
-static int win_width, win_height;
-static bool redraw_pending;
+
+#define MAX_OUTPUTS 16
+
+// X events are handled in batches: everything pending is read first, and
+// only the result is posted to the render thread
+struct XEventBatch {
+    Rect size;          // last configured size
+    Rect posted_size;   // size the render thread was last told about
+    Rect expose;        // union of the exposed areas, in X coordinates
+    bool resized;
+};
+static XEventBatch xbatch[MAX_OUTPUTS];
+static int xev_count;
+static int xev_batches;
+static int xev_configure_merged;
+static int xev_expose_merged;
+
+// outputs
+static Output outputs[MAX_OUTPUTS];
+static int num_outputs = 1;
+
+static bool opt_headless;
+static bool opt_threads;
+static bool opt_novsync;
+static bool opt_nodamage;
+static bool opt_nowarmup;
+static bool opt_fbo;
+static long opt_budget;
+static bool opt_compute;
+static const char *opt_record;
+static const char *opt_replay;
+static bool opt_replay_only;
+static int opt_frames = 300;
+static int opt_rate;
+static int opt_display_rate = 60;
+static int opt_load;
+static const char *opt_images;
+static int opt_workers;
+static long opt_upload_kb = 4096;
+static long opt_upload_ms;
+
+// threaded presentation
+static pthread_mutex_t present_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t present_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t present_done_cond = PTHREAD_COND_INITIALIZER;
+static int present_frame;
+static int present_done;
+static bool present_quit;
+
+static long present_rounds_usec;
+static long present_max_usec;
+static int present_rounds;
+
+// image loaded after startup, shown once it's completely uploaded
+static unsigned char *load_pixels;
+static PooledTexture *load_tex;     // until it's published
+static TileUpload *load_upload;
+static int load_frames;
+
+// render thread, owns the consumer context
+static pthread_t render_tid;
+static CommandQueue render_queue;
+static int render_batches;
+static int render_cmds;
+static int render_resizes_dropped;
+static bool render_redraw;
+
+// frame pacing: the producer publishes its newest finished frame, and the
+// render thread picks it up on its own ticks
+struct ContentFrame {
+    PooledTexture *ptex;
+    GLsync fence;       // signaled once the content is complete
+    long content_usec;
+};
+static pthread_mutex_t frame_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ContentFrame newest_frame;
+static long shown_content_usec;
+static pthread_t producer_tid;
+static bool producer_quit;
+static PacingStats pacing;
+static long paced_usec;
+
+// image sequence, decoded on a pool of workers into mapped pixel unpack
+// buffers, which the producer uploads from in order
+#define INGEST_DEPTH 4
+
+struct IngestSlot {
+    ImageFile img;
+    GLuint pbo;
+    long pbo_size;
+    DecodeJob job;
+};
+
+struct IngestStats {
+    int images, failed;
+    long decode_bytes;
+    long decode_start, decode_end;
+    long upload_bytes, upload_usec;
+};
+
+static char **image_paths;
+static int num_images;
+static bool ingest_done;
+static IngestStats ingest;
+
+// startup
+static pthread_t gl_init_tid;
+static bool gl_init_async;
+static bool gl_init_result;
+static long gl_init_usec;
+
+struct Phase {
+    const char *name;
+    long usec;
+};
+
+#define MAX_PHASES 16
+static Phase phases[MAX_PHASES];
+static int num_phases;
+static long startup_start;
 
 int main(int argc, char **argv)
 {
+    startup_start = get_time_usec();
+
+    if (!parse_args(argc, argv))
+        return 1;
+
+    if (opt_budget)
+        mem_set_budget(opt_budget, over_budget, 0);
+
+    if (opt_replay)
+        return replay() ? 0 : 1;
+
+    if (opt_record && !trace_record_start(opt_record, num_outputs, 800, 600))
+        return 1;
+
     if (!init()) {
         fprintf(stderr, "Failed to initialize EGL context.\n");
         return 1;
     }
 
-    eglMakeCurrent(egl_dpy, egl_surf, egl_surf, ctx_es.ctx);
-    if (!gl_init())
+    if (!gl_init_wait())
         return 1;
 
-    // event loop
-    for (;;) {
-        XEvent xev;
-        XNextEvent(xdpy, &xev);
-        if (!handle_xevent(&xev))
-            break;
-        if (redraw_pending) {
-            redraw_pending = false;
-            display();
+    long t;
+    if (opt_load) {
+        t = get_time_usec();
+        if (!(load_pixels = gen_xor_image(opt_load))) {
+            fprintf(stderr, "Failed to allocate a %dx%d image.\n", opt_load, opt_load);
+            return 1;
+        }
+        add_phase("image to load", t);
+    }
+
+    t = get_time_usec();
+    if (opt_images && !list_images(opt_images))
+        return 1;
+
+    if ((opt_rate || opt_images) && !producer_start())
+        return 1;
+    if (!present_start() || !render_start())
+        return 1;
+    add_phase("consumer setup", t);
+
+    print_phases();
+
+    if (!opt_headless) {
+        // event loop, all the drawing happens on the render thread
+        bool quit = false;
+        while (!quit) {
+            // wait for the first event, then take whatever queued up
+            // behind it before telling the render thread
+            XEvent xev;
+            XNextEvent(xdpy, &xev);
+            quit = !handle_xevent(&xev);
+            while (!quit && XPending(xdpy)) {
+                XNextEvent(xdpy, &xev);
+                quit = !handle_xevent(&xev);
+            }
+            flush_xevents();
         }
     }
 
+    render_stop();
+    producer_stop();
+    present_stop();
+    print_present_stats();
+    trace_record_stop();
+
     cleanup();
     return 0;
 }
 
 static bool
-init()
+parse_args(int argc, char **argv)
 {
-    if (!(xdpy = XOpenDisplay(0))) {
-        fprintf(stderr, "Failed to connect to the X server.\n");
-        return 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-outputs") == 0 && i + 1 < argc) {
+            num_outputs = atoi(argv[++i]);
+            if (num_outputs < 1 || num_outputs > MAX_OUTPUTS) {
+                fprintf(stderr, "Number of outputs must be 1-%d.\n", MAX_OUTPUTS);
+                return false;
+            }
+        } else if (strcmp(argv[i], "-headless") == 0) {
+            opt_headless = true;
+        } else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            opt_frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-threads") == 0) {
+            opt_threads = true;
+        } else if (strcmp(argv[i], "-novsync") == 0) {
+            opt_novsync = true;
+        } else if (strcmp(argv[i], "-nodamage") == 0) {
+            opt_nodamage = true;
+        } else if (strcmp(argv[i], "-nowarmup") == 0) {
+            opt_nowarmup = true;
+        } else if (strcmp(argv[i], "-fbo") == 0) {
+            opt_fbo = true;
+        } else if (strcmp(argv[i], "-compute") == 0) {
+            opt_compute = true;
+        } else if (strcmp(argv[i], "-record") == 0 && i + 1 < argc) {
+            opt_record = argv[++i];
+        } else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc) {
+            opt_replay = argv[++i];
+        } else if (strcmp(argv[i], "-rate") == 0 && i + 1 < argc) {
+            opt_rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-display-rate") == 0 && i + 1 < argc) {
+            opt_display_rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-images") == 0 && i + 1 < argc) {
+            opt_images = argv[++i];
+        } else if (strcmp(argv[i], "-workers") == 0 && i + 1 < argc) {
+            opt_workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-load") == 0 && i + 1 < argc) {
+            opt_load = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-upload-kb") == 0 && i + 1 < argc) {
+            opt_upload_kb = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-upload-ms") == 0 && i + 1 < argc) {
+            opt_upload_ms = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-budget") == 0 && i + 1 < argc) {
+            opt_budget = atol(argv[++i]) * 1048576;
+        } else {
+            fprintf(stderr, "Usage: %s [options]\n"
+                    "  -outputs <n>  present the shared texture to n windows\n"
+                    "  -headless     use pbuffers instead of windows\n"
+                    "  -frames <n>   number of frames to present in headless mode\n"
+                    "  -threads      one presentation thread and context per output\n"
+                    "  -novsync      don't wait for vertical sync on swap\n"
+                    "  -nodamage     always redraw and swap the whole output\n"
+                    "  -nowarmup     don't draw with the programs before the first frame\n"
+                    "  -fbo          render through an intermediate framebuffer\n"
+                    "  -budget <mb>  GPU memory budget, pooled textures are evicted above it\n"
+                    "  -compute      generate the shared texture with a compute shader\n"
+                    "  -rate <hz>    produce frames at this rate, presented at the display rate\n"
+                    "  -display-rate <hz>  display rate used with -rate (default: 60)\n"
+                    "  -images <p>   show the images of a directory (PPM, PAM, PNG) in sequence\n"
+                    "  -workers <n>  number of image decoding threads (default: one per CPU)\n"
+                    "  -load <n>     load an n x n image after startup, in tiles\n"
+                    "  -upload-kb <kb>  upload budget per frame for -load (default: 4096, 0: none)\n"
+                    "  -upload-ms <ms>  upload time budget per frame for -load (default: none)\n"
+                    "  -record <f>   record the GL/EGL calls and their payloads to a file\n"
+                    "  -replay <f>   replay a recording as fast as possible and exit\n",
+                    argv[0]);
+            return false;
+        }
+    }
+
+    // the recording covers the calls of the default single context paths
+    if (opt_record && (opt_threads || opt_fbo || opt_compute)) {
+        fprintf(stderr, "-record can't be combined with -threads, -fbo or -compute.\n");
+        return false;
+    }
+    if (opt_rate < 0 || opt_display_rate < 1) {
+        fprintf(stderr, "Invalid frame rate.\n");
+        return false;
     }
+    // the frames are synchronized with the one consumer context
+    if ((opt_rate || opt_images) && (opt_threads || opt_record)) {
+        fprintf(stderr, "-rate and -images can't be combined with -threads or -record.\n");
+        return false;
+    }
+    // both replace the shared texture, and the upload runs on the consumer
+    // context, which isn't current anywhere with -threads
+    if (opt_load && (opt_rate || opt_images || opt_record || opt_threads)) {
+        fprintf(stderr, "-load can't be combined with -rate, -images, -record or -threads.\n");
+        return false;
+    }
+    if (opt_workers < 0) {
+        fprintf(stderr, "Invalid number of workers.\n");
+        return false;
+    }
+    if (!opt_workers && (opt_workers = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+        opt_workers = 1;
+    if (opt_load < 0 || opt_upload_kb < 0 || opt_upload_ms < 0) {
+        fprintf(stderr, "Invalid image size or upload budget.\n");
+        return false;
+    }
+    return true;
+}
+
+static bool
+replay()
+{
+    int num_surfs, width, height;
+    if (!trace_read_header(opt_replay, &num_surfs, &width, &height))
+        return false;
+
+    // the recording decides the outputs, pbuffers are enough to replay it
+    if (num_surfs < 1 || num_surfs > MAX_OUTPUTS) {
+        fprintf(stderr, "Unsupported number of surfaces in the trace: %d.\n", num_surfs);
+        return false;
+    }
+    num_outputs = num_surfs;
+    opt_headless = true;
+    opt_replay_only = true;
+
+    if (!init()) {
+        fprintf(stderr, "Failed to initialize EGL context.\n");
+        return false;
+    }
+
+    EGLContext ctx[TRACE_NUM_CTX];
+    ctx[TRACE_CTX_CONSUMER] = ctx_es.ctx;
+    ctx[TRACE_CTX_PRODUCER] = ctx_angle.ctx;
+    EGLSurface surfs[MAX_OUTPUTS];
+    for (int i = 0; i < num_outputs; i++) {
+        surfs[i] = outputs[i].surf;
+    }
+
+    TraceStats stats;
+    bool res = trace_replay(opt_replay, egl_dpy, ctx, surfs, num_outputs, &stats);
+    if (res) {
+        fprintf(stderr, "replay: %d calls, %d frames, %.2f MB of payloads\n",
+                stats.ops, stats.frames, stats.payload_bytes / 1048576.0);
+        fprintf(stderr, "  total: %8.3f ms\n", stats.usec / 1000.0);
+        if (stats.frames) {
+            fprintf(stderr, "  frame: %8.3f ms\n", stats.usec / 1000.0 / stats.frames);
+        }
+    }
+
+    cleanup();
+    return res;
+}
+
+static bool
+init()
+{
+    long t = get_time_usec();
+
+    // headless there are only pbuffers, and no need for an X server
+    if (!opt_headless) {
+        // the GL init thread uses EGL while we keep talking to X
+        XInitThreads();
+
+        if (!(xdpy = XOpenDisplay(0))) {
+            fprintf(stderr, "Failed to connect to the X server.\n");
+            return false;
+        }
 
-    xscr = DefaultScreen(xdpy);
-    xroot = RootWindow(xdpy, xscr);
+        xscr = DefaultScreen(xdpy);
+        xroot = RootWindow(xdpy, xscr);
 
-    xa_wm_proto = XInternAtom(xdpy, "WM_PROTOCOLS", False);
-    xa_wm_del_win = XInternAtom(xdpy, "WM_DELETE_WINDOW", False);
+        xa_wm_proto = XInternAtom(xdpy, "WM_PROTOCOLS", False);
+        xa_wm_del_win = XInternAtom(xdpy, "WM_DELETE_WINDOW", False);
+        add_phase("X connection", t);
+    }
 
 	/* init EGL/ES ctx reqs */
+    t = get_time_usec();
     if (!egl_init()) {
         return false;
 	}
+    egl_init_ext();
 
 	/* select EGL/ES config */
     ctx_es.config = egl_choose_config();
     if (!ctx_es.config) {
         return false;
 	}
+    add_phase("EGL init", t);
+
+	/* create EGL context */
+    t = get_time_usec();
+    if (!egl_create_context(&ctx_es, 0)) {
+        return false;
+	}
+
+	ctx_angle.config = ctx_es.config;
+	/* create ANGLE context */
+	if (!egl_create_context(&ctx_angle, ctx_es.ctx)) {
+		return false;
+	}
+    add_phase("contexts", t);
+
+    // The contexts don't need the window: compile the shaders and create
+    // the texture on the ANGLE context while we wait for X.
+    if (!opt_replay_only && !gl_init_start())
+        return false;
 
 	// On WebKit we will draw to textures so we won't need to mess with
 	// visuals. For THIS test, we are going to use the same visual in angle.
+    t = get_time_usec();
     EGLint vis_id;
     eglGetConfigAttrib(egl_dpy, ctx_es.config, EGL_NATIVE_VISUAL_ID, &vis_id);
 
     // NOTE to myself:
     // create x window: this is going to be used by both contexts
     /////////////////////////////////////////////////////////////
-    win = x_create_window(vis_id, 800, 600);
-    if (!win)
-        return false;
+    for (int i = 0; i < num_outputs && !opt_headless; i++) {
+        outputs[i].win = x_create_window(vis_id, 800, 600);
+        if (!outputs[i].win)
+            return false;
+    }
     ////////////////////////////////////////////////////////////
+    if (!opt_headless)
+        add_phase("X windows", t);
+
+	/* create EGL/ES surfaces */
+    t = get_time_usec();
+    mem_set_context("EGL");
+    for (int i = 0; i < num_outputs; i++) {
+        Output *out = outputs + i;
+        snprintf(out->name, sizeof out->name, "output %d", i);
+
+        if (opt_headless) {
+            EGLint pbuf_atts[] = {
+                EGL_WIDTH, 800,
+                EGL_HEIGHT, 600,
+                EGL_NONE
+            };
+            out->surf = eglCreatePbufferSurface(egl_dpy, ctx_es.config, pbuf_atts);
+            out->mapped = true;
+        } else {
+            out->surf = eglCreateWindowSurface(egl_dpy, ctx_es.config, out->win, 0);
+        }
+        out->width = 800;
+        out->height = 600;
+        Rect full = {0, 0, out->width, out->height};
+        xbatch[i].size = xbatch[i].posted_size = full;
+        out->damage = full;
+        if (out->surf == EGL_NO_SURFACE) {
+            fprintf(stderr, "Failed to create EGL surface for output %d.\n", i);
+            return false;
+        }
+        mem_track(MEM_SURFACE, (unsigned long)out->surf,
+                egl_surface_size(out->width, out->height, !opt_headless),
+                opt_headless ? "pbuffer" : "window surface");
 
-	/* create EGL/ES surface */
-    egl_surf = eglCreateWindowSurface(egl_dpy, ctx_es.config, win, 0);
-    if (egl_surf == EGL_NO_SURFACE) {
-        fprintf(stderr, "Failed to create EGL surface for win.\n");
-        return false;
+        // each presentation thread needs a context of its own
+        out->ctx = ctx_es;
+        if (opt_threads && !egl_create_context(&out->ctx, ctx_es.ctx)) {
+            return false;
+        }
     }
-
-	/* create EGL context */
-    if (!egl_create_context(&ctx_es, 0)) {
-        return false;
-	}
-
-	ctx_angle.config = ctx_es.config;
-	/* create ANGLE context */
-	if (!egl_create_context(&ctx_angle, ctx_es.ctx)) {
-		return false;
-	}
+    add_phase("EGL surfaces", t);
 
     return true;
 }
@@ -165,8 +606,17 @@ init()
 static bool
 egl_init()
 {
-    // create an EGL display
-    if ((egl_dpy = eglGetPlatformDisplay(EGL_PLATFORM_X11_EXT, (void *)xdpy, NULL)) == EGL_NO_DISPLAY) {
+    // create an EGL display: on the X server, or headless, on any platform
+    // that doesn't need one
+    const char *client_exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (!opt_headless) {
+        egl_dpy = eglGetPlatformDisplay(EGL_PLATFORM_X11_EXT, (void *)xdpy, NULL);
+    } else if (client_exts && strstr(client_exts, "EGL_MESA_platform_surfaceless")) {
+        egl_dpy = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    } else {
+        egl_dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (egl_dpy == EGL_NO_DISPLAY) {
         fprintf(stderr, "Failed to get EGL display.\n");
         return false;
     }
@@ -181,14 +631,37 @@ egl_init()
     return (eglGetError() == EGL_SUCCESS);
 }
 
+static void
+egl_init_ext()
+{
+    const char *exts = eglQueryString(egl_dpy, EGL_EXTENSIONS);
+    if (!exts)
+        return;
+
+    if (strstr(exts, "EGL_KHR_swap_buffers_with_damage")) {
+        egl_swap_buffers_with_damage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+            eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+    } else if (strstr(exts, "EGL_EXT_swap_buffers_with_damage")) {
+        egl_swap_buffers_with_damage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+            eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+    }
+    if (strstr(exts, "EGL_KHR_partial_update")) {
+        egl_set_damage_region = (PFNEGLSETDAMAGEREGIONKHRPROC)
+            eglGetProcAddress("eglSetDamageRegionKHR");
+    }
+    // partial update defines the buffer age query as well
+    egl_buffer_age = strstr(exts, "EGL_EXT_buffer_age") || egl_set_damage_region;
+    egl_khr_create_context = strstr(exts, "EGL_KHR_create_context");
+}
+
 static EGLConfig
 egl_choose_config()
 {
     // select an EGL configuration
     EGLint attr_list[] = {
         EGL_COLOR_BUFFER_TYPE, EGL_RGB_BUFFER,
-        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-        EGL_SURFACE_TYPE, EGL_WINDOW_BIT | EGL_PIXMAP_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
+        EGL_SURFACE_TYPE, opt_headless ? EGL_PBUFFER_BIT : EGL_WINDOW_BIT | EGL_PIXMAP_BIT,
         EGL_RED_SIZE, 8,
         EGL_BLUE_SIZE, 8,
         EGL_GREEN_SIZE, 8,
@@ -210,9 +683,14 @@ egl_choose_config()
 static bool
 egl_create_context(EGL_ctx *ctx, EGLContext shared)
 {
+    // compute shaders need 3.1: without KHR_create_context only
+    // the major version can be asked for, and the driver decides the minor
     EGLint ctx_atts[] = {
-        EGL_CONTEXT_CLIENT_VERSION, 2,
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 1,
         EGL_NONE };
+    if (!egl_khr_create_context)
+        ctx_atts[2] = EGL_NONE;
 
     ctx->ctx = eglCreateContext(egl_dpy, ctx->config, shared ? shared : EGL_NO_CONTEXT, ctx_atts);
     if (!ctx->ctx) {
@@ -223,6 +701,23 @@ egl_create_context(EGL_ctx *ctx, EGLContext shared)
     return (eglGetError() == EGL_SUCCESS);
 }
 
+// The GL format closest to the color buffer of an EGL config
+static GLenum
+egl_config_format(EGLConfig config)
+{
+    EGLint r = 0, g = 0, b = 0, a = 0;
+    eglGetConfigAttrib(egl_dpy, config, EGL_RED_SIZE, &r);
+    eglGetConfigAttrib(egl_dpy, config, EGL_GREEN_SIZE, &g);
+    eglGetConfigAttrib(egl_dpy, config, EGL_BLUE_SIZE, &b);
+    eglGetConfigAttrib(egl_dpy, config, EGL_ALPHA_SIZE, &a);
+
+    if (r == 10 && g == 10 && b == 10)
+        return GL_RGB10_A2;
+    if (r == 5 && g == 6 && b == 5)
+        return GL_RGB565;
+    return a ? GL_RGBA8 : GL_RGB8;
+}
+
 Window
 x_create_window(int vis_id, int win_w, int win_h)
 {
@@ -274,27 +769,42 @@ x_create_window(int vis_id, int win_w, int win_h)
     return win;
 }
 
+static Output *
+find_output(Window win)
+{
+    for (int i = 0; i < num_outputs; i++) {
+        if (outputs[i].win == win)
+            return outputs + i;
+    }
+    return 0;
+}
+
 static bool
 handle_xevent(XEvent *ev)
 {
-    static bool mapped;
+    Output *out = find_output(ev->xany.window);
     KeySym sym;
 
+    xev_count++;
+    if (!out)
+        return true;
+
     switch(ev->type) {
     case MapNotify:
-        mapped = true;
-        break;
     case UnmapNotify:
-        mapped = false;
+        {
+            Rect r = {0, 0, ev->type == MapNotify, 0};
+            post_command(CMD_MAP, out, r);
+        }
         break;
     case ConfigureNotify:
-        if (ev->xconfigure.width != win_width ||
-                ev->xconfigure.height != win_height)
         {
-            win_width = ev->xconfigure.width;
-            win_height = ev->xconfigure.height;
-
-            reshape(win_width, win_height);
+            XEventBatch *b = xbatch + (out - outputs);
+            if (b->resized)
+                xev_configure_merged++;
+            b->size.width = ev->xconfigure.width;
+            b->size.height = ev->xconfigure.height;
+            b->resized = true;
         }
         break;
     case ClientMessage:
@@ -305,8 +815,14 @@ handle_xevent(XEvent *ev)
         }
         break;
     case Expose:
-        if (mapped)
-            redraw_pending = true;
+        {
+            XEventBatch *b = xbatch + (out - outputs);
+            if (!rect_empty(b->expose))
+                xev_expose_merged++;
+            Rect r = {ev->xexpose.x, ev->xexpose.y,
+                ev->xexpose.width, ev->xexpose.height};
+            b->expose = rect_union(b->expose, r);
+        }
         break;
     case KeyPress:
         if(!(sym = XLookupKeysym(&ev->xkey, 0)))
@@ -320,23 +836,69 @@ handle_xevent(XEvent *ev)
     return true;
 }
 
+// Posts what the batch of X events amounts to: at most one resize and one
+// redraw per output. Map state changes were posted in order as they came.
+static void
+flush_xevents()
+{
+    for (int i = 0; i < num_outputs; i++) {
+        XEventBatch *b = xbatch + i;
+
+        if (b->resized && (b->size.width != b->posted_size.width ||
+                    b->size.height != b->posted_size.height))
+        {
+            post_command(CMD_RESIZE, outputs + i, b->size);
+            b->posted_size = b->size;
+        }
+        if (!rect_empty(b->expose))
+            post_command(CMD_REDRAW, outputs + i, b->expose);
+
+        b->resized = false;
+        b->expose.width = b->expose.height = 0;
+    }
+    xev_batches++;
+}
+
 static void
 cleanup()
 {
+    eglMakeCurrent(egl_dpy, outputs[0].surf, outputs[0].surf, ctx_es.ctx);
+    for (int i = 0; i < num_outputs; i++) {
+        rt_release(outputs[i].rt);
+        outputs[i].rt = 0;
+    }
+    rt_collect(0);
     gl_cleanup();
+    eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
     // FIXME EGL
     // destroy context, surface, display
+    for (int i = 0; i < num_outputs; i++) {
+        if (outputs[i].ctx.ctx != ctx_es.ctx)
+            eglDestroyContext(egl_dpy, outputs[i].ctx.ctx);
+        mem_untrack(MEM_SURFACE, (unsigned long)outputs[i].surf);
+        eglDestroySurface(egl_dpy, outputs[i].surf);
+    }
     eglTerminate(egl_dpy);
 
-	XDestroyWindow(xdpy, win);
-	XCloseDisplay(xdpy);
+    for (int i = 0; i < num_outputs; i++) {
+        if (outputs[i].win)
+            XDestroyWindow(xdpy, outputs[i].win);
+    }
+    if (xdpy)
+        XCloseDisplay(xdpy);
+
+    for (int i = 0; i < num_images; i++) {
+        free(image_paths[i]);
+    }
+    free(image_paths);
 }
 
 static bool
 gl_init()
 {
-	// Context that draws
-	eglMakeCurrent(egl_dpy, egl_surf, egl_surf, ctx_es.ctx);
+	// Called with the context that creates the image current. Everything
+	// created here is shared with the context that draws.
 	static const float vertices[] = {
 		1.0, 1.0,
 		1.0, 0.0,
@@ -347,20 +909,190 @@ gl_init()
 	glGenBuffers(1, &gl_vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, gl_vbo);
 	glBufferData(GL_ARRAY_BUFFER, sizeof vertices, vertices, GL_STATIC_DRAW);
+    trace_buffer(gl_vbo, vertices, sizeof vertices);
+    mem_track(MEM_BUFFER, gl_vbo, sizeof vertices, "vertices");
 
-    gl_prog = create_program_load("data/texmap.vert", "data/texmap.frag");
-    glClearColor(1.0, 1.0, 0.0, 1.0);
+    // with alpha in the surface, content with alpha would make the window
+    // translucent: the variant for it is compiled here, before any frame
+    EGLint alpha = 0;
+    eglGetConfigAttrib(egl_dpy, ctx_es.config, EGL_ALPHA_SIZE, &alpha);
+    const char *texmap_defs = alpha ? "OPAQUE" : 0;
+
+    gl_prog = get_program_variant_embedded(shaders::texmap_vert, shaders::texmap_frag, texmap_defs);
+    if (!gl_prog) {
+        return false;
+    }
+    // the trace has the sources as they were compiled
+    char *texmap_src = shader_source_defs(shaders::texmap_frag.src, texmap_defs);
+    if (!texmap_src)
+        return false;
+    trace_program(gl_prog, shaders::texmap_vert.src, texmap_src);
+    free(texmap_src);
+    shaders::get_uniforms(gl_prog, &gl_prog_uniforms);
+    bind_program(gl_prog);
+    set_uniform(gl_prog_uniforms, shaders::uniform::tex, 0);
+    bind_program(0);
+
+    // how display() draws with it: to the window surface, and to the
+    // intermediate targets with -fbo
+    WarmupState texmap_state = {false, GL_RGBA8, (GLuint)shaders::attrib::vertex, 2,
+        GL_TRIANGLE_STRIP, egl_config_format(ctx_es.config)};
+    warmup_register("texmap", gl_prog, texmap_state);
+    if (opt_fbo && texmap_state.target_format != GL_RGBA8) {
+        texmap_state.target_format = GL_RGBA8;
+        warmup_register("texmap (fbo)", gl_prog, texmap_state);
+    }
+
+    // immutable storage: nothing to revalidate in the other contexts
+    if (!(gl_tex = tex_acquire(256, 256, GL_RGBA8, 1))) {
+        return false;
+    }
+    trace_texture(gl_tex->tex, gl_tex->width, gl_tex->height, gl_tex->format, gl_tex->levels);
+
+    if (opt_compute) {
+        unsigned int prog = create_compute_program_embedded(shaders::xor_comp);
+        shaders::Uniforms uni;
+        if (prog)
+            shaders::get_uniforms(prog, &uni);
+        bool res = prog && gen_xor_compute(gl_tex, prog, uni, 0);
+        free_program(prog);
+        if (!res)
+            return false;
+    } else {
+        gen_xor_cpu(gl_tex, 0);
+    }
+
+    // the storage of the image to load is allocated here, with everything
+    // else, rather than in the first frame of the upload
+    if (opt_load) {
+        GLint max_size = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+        if (opt_load > max_size || !(load_tex = tex_acquire(opt_load, opt_load, GL_RGBA8, 1))) {
+            fprintf(stderr, "Failed to create a %dx%d texture.\n", opt_load, opt_load);
+            return false;
+        }
+    }
+	glFinish();
+    trace_finish();
+
+    // the programs are shared: compiling their variants here, offscreen,
+    // spares the first frame of the consumer
+    if (!opt_nowarmup)
+        warmup_run();
+
+    tex_width = 256;
+    tex_height = 256;
+    Rect r = {0, 0, tex_width, tex_height};
+    damage_texture(r);
+
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+static void *
+gl_init_thread(void *)
+{
+    long t = get_time_usec();
+
+    eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx_angle.ctx);
+    trace_make_current(TRACE_CTX_PRODUCER, TRACE_NO_SURFACE);
+    mem_set_context("ctx_angle");
+    gl_init_result = gl_init();
+    // release it, so that it can be made current on the main thread later
+    eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+    gl_init_usec = get_time_usec() - t;
+    return 0;
+}
+
+// Same pattern as gen_xor_cpu, at any size, in a buffer to upload later.
+static unsigned char *
+gen_xor_image(int size)
+{
+    unsigned char *pixels = (unsigned char *)malloc((long)size * size * 4);
+    if (!pixels)
+        return 0;
+
+    unsigned char *pptr = pixels;
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            *pptr++ = i ^ j;
+            *pptr++ = (i ^ j) << 1;
+            *pptr++ = (i ^ j) << 2;
+            *pptr++ = 255;
+        }
+    }
+    return pixels;
+}
+
+// Continues uploading the loaded image within the per frame budget, the
+// tiles under the damage of the outputs first. The last tile is fenced and
+// the texture published like a produced frame; the consumer keeps showing
+// the old texture until the fence is signaled, then latches it. Returns
+// true once it's shown.
+static bool
+upload_frame()
+{
+    load_frames++;
+
+    if (!load_upload && !(load_upload = upload_start(load_tex, load_pixels))) {
+        fprintf(stderr, "Failed to start uploading the %dx%d image.\n", opt_load, opt_load);
+        free(load_pixels);
+        load_pixels = 0;
+        return false;
+    }
+
+    if (upload_done(load_upload)) {
+        // latching earlier would stall the frame on the rest of the upload
+        pthread_mutex_lock(&frame_mutex);
+        GLsync fence = newest_frame.fence;
+        pthread_mutex_unlock(&frame_mutex);
+        GLenum res = glClientWaitSync(fence, 0, 0);
+        if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+            return false;
+
+        latch_frame();
+        free(load_pixels);
+        load_pixels = 0;
+        return true;
+    }
+
+    Rect dmg = {0, 0, 0, 0};
+    pthread_mutex_lock(&present_mutex);
+    for (int i = 0; i < num_outputs; i++) {
+        Output *out = outputs + i;
+        dmg = rect_union(dmg, rect_scale(out->damage, out->width, out->height,
+                    opt_load, opt_load));
+    }
+    pthread_mutex_unlock(&present_mutex);
+    upload_prioritize(load_upload, dmg);
+
+    bool done = upload_step(load_upload, opt_upload_kb * 1024, opt_upload_ms * 1000);
+    // the driver may defer the copies: flushed here, they cost this frame
+    // and not the one that flushes everything at once
+    glFlush();
+    if (done) {
+        ContentFrame frame;
+        frame.ptex = load_tex;
+        frame.content_usec = get_time_usec();
+        publish_frame(frame);
+        load_tex = 0;
+    }
+    return false;
+}
 
-	// Context that creates the image
-	eglMakeCurrent(egl_dpy, egl_surf, egl_surf, ctx_angle.ctx);
+// the offset scrolls the pattern, for animated content
+static void
+gen_xor_cpu(PooledTexture *ptex, int offset)
+{
 	// xor image
 	unsigned char pixels[256 * 256 * 4];
 	unsigned char *pptr = pixels;
 	for (int i = 0; i < 256; i++) {
 		for (int j = 0; j < 256; j++) {
-			int r = (i ^ j);
-			int g = (i ^ j) << 1;
-			int b = (i ^ j) << 2;
+			int r = ((i + offset) ^ j);
+			int g = ((i + offset) ^ j) << 1;
+			int b = ((i + offset) ^ j) << 2;
 
 			*pptr++ = r;
 			*pptr++ = g;
@@ -369,57 +1101,1068 @@ gl_init()
 		}
 	}
 
-    glGenTextures(1, &gl_tex);
-    glBindTexture(GL_TEXTURE_2D, gl_tex);
+    glBindTexture(GL_TEXTURE_2D, ptex->tex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 256, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    trace_tex_sub_image(ptex->tex, 0, 0, 256, 256, pixels);
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// Same image, written directly to the texture on the GPU: no CPU work and
+// no upload. The texture needs immutable storage to be bound as an image.
+static bool
+gen_xor_compute(PooledTexture *ptex, unsigned int prog, const shaders::Uniforms &uni,
+        int offset)
+{
+    bind_program(prog);
+    set_uniform(uni, shaders::uniform::offset, offset);
+    glBindImageTexture(0, ptex->tex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    int res = dispatch_compute(prog, ptex->width, ptex->height, 1);
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+    // the barrier only orders this context's texture fetches after the
+    // image stores: other contexts see the texture once they wait on the
+    // fence published with it (or after the glFinish in gl_init)
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    bind_program(0);
+    return res == 0;
+}
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 256, 256, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-	glFinish();
+static bool
+gl_init_start()
+{
+    // without surfaceless contexts there's nothing to bind the ANGLE
+    // context to before the window exists: gl_init_wait does it in sequence
+    const char *exts = eglQueryString(egl_dpy, EGL_EXTENSIONS);
+    if (!exts || !strstr(exts, "EGL_KHR_surfaceless_context")) {
+        fprintf(stderr, "EGL_KHR_surfaceless_context not supported, GL init after the window.\n");
+        return true;
+    }
 
+    if (pthread_create(&gl_init_tid, 0, gl_init_thread, 0) != 0) {
+        fprintf(stderr, "Failed to start the GL init thread.\n");
+        return true;
+    }
+    gl_init_async = true;
+    return true;
+}
 
-    return glGetError() == GL_NO_ERROR;
+static bool
+gl_init_wait()
+{
+    long t = get_time_usec();
+
+    if (gl_init_async) {
+        pthread_join(gl_init_tid, 0);
+        add_phase("wait for GL init", t);
+    } else {
+        // Context that creates the image
+        eglMakeCurrent(egl_dpy, outputs[0].surf, outputs[0].surf, ctx_angle.ctx);
+        trace_make_current(TRACE_CTX_PRODUCER, 0);
+        mem_set_context("ctx_angle");
+        gl_init_result = gl_init();
+        eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        gl_init_usec = get_time_usec() - t;
+    }
+    fprintf(stderr, "GL init: %.3f ms%s\n", gl_init_usec / 1000.0,
+            gl_init_async ? " (overlapped with window setup)" : "");
+    warmup_print_stats(stderr);
+
+    if (!gl_init_result) {
+        fprintf(stderr, "Failed to initialize GL resources.\n");
+        return false;
+    }
+    return true;
+}
+
+static void
+add_phase(const char *name, long start)
+{
+    if (num_phases < MAX_PHASES) {
+        phases[num_phases].name = name;
+        phases[num_phases].usec = get_time_usec() - start;
+        num_phases++;
+    }
+}
+
+static void
+print_phases()
+{
+    fprintf(stderr, "startup:\n");
+    for (int i = 0; i < num_phases; i++) {
+        fprintf(stderr, "  %-20s %8.3f ms\n", phases[i].name, phases[i].usec / 1000.0);
+    }
+    fprintf(stderr, "  %-20s %8.3f ms\n", "total",
+            (get_time_usec() - startup_start) / 1000.0);
 }
 
 static void
 gl_cleanup()
 {
-    free_program(gl_prog);
+    warmup_clear();
+    // gl_prog is one of them
+    free_program_variants();
     glBindTexture(GL_TEXTURE_2D, 0);
 
-    glDeleteTextures(1, &gl_tex);
-    glDeleteProgram(gl_prog);
+    // not published yet, the texture isn't gl_tex or the newest frame
+    tex_release(load_tex);
+    load_tex = 0;
+    upload_free(load_upload);
+    load_upload = 0;
+    free(load_pixels);
+    load_pixels = 0;
+
+    // produced, but never shown
+    if (newest_frame.ptex) {
+        glDeleteSync(newest_frame.fence);
+        tex_release(newest_frame.ptex);
+        newest_frame.ptex = 0;
+    }
+
+    tex_release(gl_tex);
+    gl_tex = 0;
+    tex_pool_cleanup();
+
+    mem_untrack(MEM_BUFFER, gl_vbo);
+    glDeleteBuffers(1, &gl_vbo);
+}
+
+static bool
+present_start()
+{
+    for (int i = 0; i < num_outputs; i++) {
+        Output *out = outputs + i;
+
+        if (opt_threads) {
+            if (pthread_create(&out->tid, 0, present_thread, out) != 0) {
+                fprintf(stderr, "Failed to start the presentation thread of output %d.\n", i);
+                return false;
+            }
+            continue;
+        }
 
-    glDeleteFramebuffers(1, &gl_fbo);
-    glDeleteRenderbuffers(1, &gl_rbo);
+        // swap interval is per surface, set it while each one is current
+        eglMakeCurrent(egl_dpy, out->surf, out->surf, ctx_es.ctx);
+        if (opt_novsync)
+            eglSwapInterval(egl_dpy, 0);
+    }
+    mem_set_context("ctx_es");
+    if (!opt_threads) {
+        glClearColor(1.0, 1.0, 0.0, 1.0);
+        trace_make_current(TRACE_CTX_CONSUMER, num_outputs - 1);
+        trace_clear_color(1.0, 1.0, 0.0, 1.0);
+    }
+    // the render thread takes it from here
+    eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    return true;
 }
 
 static void
-display()
+present_stop()
 {
+    if (!opt_threads)
+        return;
+
+    pthread_mutex_lock(&present_mutex);
+    present_quit = true;
+    pthread_cond_broadcast(&present_cond);
+    pthread_mutex_unlock(&present_mutex);
+
+    for (int i = 0; i < num_outputs; i++) {
+        pthread_join(outputs[i].tid, 0);
+    }
+}
+
+static void
+present_all()
+{
+    long t = get_time_usec();
+
+    // on the frame's budget, before drawing
+    if (load_pixels)
+        upload_frame();
+
+    if (opt_threads) {
+        // kick all the presentation threads and wait for them to finish
+        pthread_mutex_lock(&present_mutex);
+        present_done = 0;
+        present_frame++;
+        pthread_cond_broadcast(&present_cond);
+        while (present_done < num_outputs) {
+            pthread_cond_wait(&present_done_cond, &present_mutex);
+        }
+        pthread_mutex_unlock(&present_mutex);
+    } else {
+        // round-robin on the one consumer context
+        for (int i = 0; i < num_outputs; i++) {
+            display(outputs + i);
+        }
+    }
+
+    t = get_time_usec() - t;
+    if (t > present_max_usec)
+        present_max_usec = t;
+    present_rounds_usec += t;
+    present_rounds++;
+}
+
+static void *
+present_thread(void *arg)
+{
+    Output *out = (Output *)arg;
+
+    eglMakeCurrent(egl_dpy, out->surf, out->surf, out->ctx.ctx);
+    if (opt_novsync)
+        eglSwapInterval(egl_dpy, 0);
+    glClearColor(1.0, 1.0, 0.0, 1.0);
+    mem_set_context(out->name);
+
+    pthread_mutex_lock(&present_mutex);
+    for (;;) {
+        while (out->frame == present_frame && !present_quit) {
+            pthread_cond_wait(&present_cond, &present_mutex);
+        }
+        if (present_quit)
+            break;
+        out->frame = present_frame;
+        pthread_mutex_unlock(&present_mutex);
+
+        display(out);
+
+        pthread_mutex_lock(&present_mutex);
+        present_done++;
+        pthread_cond_signal(&present_done_cond);
+    }
+    pthread_mutex_unlock(&present_mutex);
+
+    // the render targets of this context can only be destroyed here
+    rt_release(out->rt);
+    out->rt = 0;
+    rt_collect(0);
+
+    eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    return 0;
+}
+
+static bool
+render_start()
+{
+    if (!cmdq_init(&render_queue)) {
+        fprintf(stderr, "Failed to create the render queue.\n");
+        return false;
+    }
+    if (pthread_create(&render_tid, 0, render_thread, 0) != 0) {
+        fprintf(stderr, "Failed to start the render thread.\n");
+        return false;
+    }
+    return true;
+}
+
+static void
+render_stop()
+{
+    if (!opt_headless) {
+        Rect r = {0, 0, 0, 0};
+        post_command(CMD_QUIT, 0, r);
+    }
+    pthread_join(render_tid, 0);
+    cmdq_destroy(&render_queue);
+}
+
+static void
+post_command(int type, Output *out, const Rect &r)
+{
+    Command cmd;
+    cmd.type = type;
+    cmd.output = out ? out - outputs : -1;
+    cmd.rect = r;
+    cmdq_push(&render_queue, cmd);
+}
+
+// The consumer context lives here, so a slow swap never holds back the X
+// events, and a burst of X events never holds back a frame.
+static void *
+render_thread(void *)
+{
+    if (!opt_threads)
+        eglMakeCurrent(egl_dpy, outputs[0].surf, outputs[0].surf, ctx_es.ctx);
+    mem_set_context("ctx_es");
+
+    if (opt_rate || opt_images) {
+        render_paced();
+    } else if (opt_headless) {
+        // nothing drives the redraws, present as fast as we can
+        for (int i = 0; i < opt_frames; i++) {
+            damage_all();
+            present_all();
+        }
+    } else {
+        for (;;) {
+            // keep presenting while there's something to upload
+            if (!load_pixels) {
+                cmdq_wait(&render_queue);
+            } else if (!cmdq_wait_usec(&render_queue, 1000000 / opt_display_rate)) {
+                present_all();
+                continue;
+            }
+            if (!render_commands(false))
+                break;
+        }
+    }
+
+    // released for the cleanup on the main thread
+    eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    return 0;
+}
+
+// Runs all the queued commands as one batch: only the last size of each
+// output matters, and any number of redraws is a single presentation. When
+// paced, the presentation waits for the next display tick.
+static bool
+render_commands(bool paced)
+{
+    Rect size[MAX_OUTPUTS];
+    Rect dmg[MAX_OUTPUTS];
+    bool resized[MAX_OUTPUTS] = {false};
+    bool redraw = false;
+
+    for (int i = 0; i < num_outputs; i++) {
+        size[i].x = size[i].y = 0;
+        size[i].width = outputs[i].width;
+        size[i].height = outputs[i].height;
+        dmg[i].width = dmg[i].height = 0;
+    }
+
+    Command cmd;
+    bool quit = false;
+    int count = 0;
+    while (cmdq_pop(&render_queue, &cmd)) {
+        count++;
+        if (cmd.type == CMD_QUIT) {
+            quit = true;
+            continue;
+        }
+
+        int idx = cmd.output;
+        switch (cmd.type) {
+        case CMD_MAP:
+            pthread_mutex_lock(&present_mutex);
+            outputs[idx].mapped = cmd.rect.width != 0;
+            pthread_mutex_unlock(&present_mutex);
+            break;
+        case CMD_RESIZE:
+            if (resized[idx])
+                render_resizes_dropped++;
+            resized[idx] = true;
+            size[idx] = cmd.rect;
+            break;
+        case CMD_REDRAW:
+            {
+                // X rectangles have their origin at the top-left, of the
+                // window with the last size X told us about
+                const Rect &r = cmd.rect;
+                Rect gl_rect = {r.x, size[idx].height - r.y - r.height, r.width, r.height};
+                dmg[idx] = rect_union(dmg[idx], gl_rect);
+                redraw = true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    render_cmds += count;
+    render_batches++;
+
+    if (quit)
+        return false;
+
+    for (int i = 0; i < num_outputs; i++) {
+        Output *out = outputs + i;
+        if (resized[i] && (size[i].width != out->width || size[i].height != out->height)) {
+            // damages the whole output
+            reshape(out, size[i].width, size[i].height);
+        } else if (!rect_empty(dmg[i])) {
+            damage_output(out, dmg[i]);
+        }
+    }
+
+    if (redraw && paced) {
+        render_redraw = true;
+    } else if (redraw) {
+        present_all();
+    }
+    return true;
+}
+
+// Presents at the display rate, with the newest frame the producer
+// finished by each tick. Between ticks it only handles the commands.
+// Headless, an image sequence is played once, to the end.
+static bool
+render_paced()
+{
+    long interval = 1000000 / opt_display_rate;
+    long start = get_time_usec();
+    long next = start + interval;
+
+    for (int i = 0; !opt_headless || opt_images || i < opt_frames; i++) {
+        long now;
+        while ((now = get_time_usec()) < next) {
+            if (opt_headless) {
+                sleep_until_usec(next);
+            } else if (cmdq_wait_usec(&render_queue, next - now) &&
+                    !render_commands(true)) {
+                return false;
+            }
+        }
+
+        bool latched = latch_frame();
+        if (latched || render_redraw) {
+            render_redraw = false;
+            present_all();
+        }
+        if (latched)
+            pacing_frame_presented(&pacing, shown_content_usec, get_time_usec());
+        paced_usec = get_time_usec() - start;
+
+        if (opt_headless && !latched && ingest_finished())
+            break;
+
+        // skip the ticks we missed instead of presenting a burst of frames
+        next += interval;
+        if (next <= get_time_usec()) {
+            pacing.late_ticks++;
+            next = get_time_usec() + interval;
+        }
+    }
+    return true;
+}
+
+// Swaps the displayed texture for the newest finished frame, if there is
+// one. The old texture goes back to the pool, fenced after our last draw.
+static bool
+latch_frame()
+{
+    pthread_mutex_lock(&frame_mutex);
+    ContentFrame frame = newest_frame;
+    newest_frame.ptex = 0;
+    if (!frame.ptex)
+        pacing.repeated++;
+    pthread_mutex_unlock(&frame_mutex);
+
+    if (!frame.ptex)
+        return false;
+
+    // the GPU may still be producing it, don't sample it before it's done
+    glWaitSync(frame.fence, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(frame.fence);
+
+    tex_release(gl_tex);
+    gl_tex = frame.ptex;
+    shown_content_usec = frame.content_usec;
+    tex_width = gl_tex->width;
+    tex_height = gl_tex->height;
+
+    Rect r = {0, 0, tex_width, tex_height};
+    damage_texture(r);
+    return true;
+}
+
+static bool
+producer_start()
+{
+    // the producer has no surface of its own
+    const char *exts = eglQueryString(egl_dpy, EGL_EXTENSIONS);
+    if (!exts || !strstr(exts, "EGL_KHR_surfaceless_context")) {
+        fprintf(stderr, "-rate and -images need EGL_KHR_surfaceless_context.\n");
+        return false;
+    }
+
+    if (pthread_create(&producer_tid, 0, opt_images ? ingest_thread : producer_thread, 0) != 0) {
+        fprintf(stderr, "Failed to start the producer thread.\n");
+        return false;
+    }
+    return true;
+}
+
+static void
+producer_stop()
+{
+    if (!opt_rate && !opt_images)
+        return;
+
+    pthread_mutex_lock(&frame_mutex);
+    producer_quit = true;
+    pthread_mutex_unlock(&frame_mutex);
+    pthread_join(producer_tid, 0);
+}
+
+// Produces a frame per period on the ANGLE context, in textures from the
+// pool, so that it never waits for the consumer to be done with the frame
+// it shows. A frame that's replaced before it's shown is dropped.
+static void *
+producer_thread(void *)
+{
+    eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx_angle.ctx);
+    mem_set_context("ctx_angle");
+
+    unsigned int prog = 0;
+    shaders::Uniforms uni;
+    if (opt_compute && !(prog = create_compute_program_embedded(shaders::xor_comp))) {
+        fprintf(stderr, "Failed to load the compute program, producing on the CPU.\n");
+    }
+    if (prog)
+        shaders::get_uniforms(prog, &uni);
+
+    long interval = 1000000 / opt_rate;
+    long next = get_time_usec();
+    for (int seq = 1; ; seq++) {
+        sleep_until_usec(next);
+
+        pthread_mutex_lock(&frame_mutex);
+        bool quit = producer_quit;
+        pthread_mutex_unlock(&frame_mutex);
+        if (quit)
+            break;
+
+        ContentFrame frame;
+        frame.content_usec = get_time_usec();
+        if (!(frame.ptex = tex_acquire(tex_width, tex_height, GL_RGBA8, 1)))
+            break;
+        if (prog) {
+            gen_xor_compute(frame.ptex, prog, uni, seq);
+        } else {
+            gen_xor_cpu(frame.ptex, seq);
+        }
+        publish_frame(frame);
+
+        next += interval;
+        if (next < get_time_usec())
+            next = get_time_usec();
+    }
+
+    free_program(prog);
+    eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    return 0;
+}
+
+// Fences the frame and makes it the newest one, in the producer context.
+static void
+publish_frame(ContentFrame frame)
+{
+    frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    pthread_mutex_lock(&frame_mutex);
+    ContentFrame old = newest_frame;
+    newest_frame = frame;
+    pacing.produced++;
+    if (old.ptex)
+        pacing.dropped++;
+    pthread_mutex_unlock(&frame_mutex);
+
+    if (old.ptex) {
+        glDeleteSync(old.fence);
+        tex_release(old.ptex);
+    }
+}
+
+static int
+image_filter(const struct dirent *ent)
+{
+    static const char *exts[] = {".ppm", ".pgm", ".pnm", ".pam", ".png"};
+
+    const char *ext = strrchr(ent->d_name, '.');
+    for (int i = 0; ext && i < (int)(sizeof exts / sizeof *exts); i++) {
+        if (strcasecmp(ext, exts[i]) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// a directory of images, in name order, or a single image
+static bool
+list_images(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        fprintf(stderr, "Failed to open %s.\n", path);
+        return false;
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        if (!(image_paths = (char **)malloc(sizeof *image_paths)) ||
+                !(image_paths[0] = strdup(path))) {
+            fprintf(stderr, "Failed to allocate the image list.\n");
+            free(image_paths);
+            image_paths = 0;
+            return false;
+        }
+        num_images = 1;
+        return true;
+    }
+
+    struct dirent **ents;
+    int num_ents = scandir(path, &ents, image_filter, alphasort);
+    if (num_ents <= 0) {
+        fprintf(stderr, "No images in %s.\n", path);
+        return false;
+    }
+
+    // the paths that couldn't be allocated are left out
+    image_paths = (char **)malloc(num_ents * sizeof *image_paths);
+    for (int i = 0; i < num_ents; i++) {
+        char *fname = 0;
+        if (image_paths &&
+                (fname = (char *)malloc(strlen(path) + strlen(ents[i]->d_name) + 2))) {
+            sprintf(fname, "%s/%s", path, ents[i]->d_name);
+            image_paths[num_images++] = fname;
+        }
+        free(ents[i]);
+    }
+    free(ents);
+    if (num_images < num_ents) {
+        fprintf(stderr, "Failed to allocate the image list.\n");
+        for (int i = 0; i < num_images; i++) {
+            free(image_paths[i]);
+        }
+        free(image_paths);
+        image_paths = 0;
+        num_images = 0;
+        return false;
+    }
+    return true;
+}
+
+// The staging buffer is mapped here, the decoder writes straight to it.
+static unsigned char *
+map_staging(IngestSlot *slot)
+{
+    long size = (long)slot->img.width * slot->img.height * 4;
+
+    if (!slot->pbo)
+        glGenBuffers(1, &slot->pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->pbo);
+    if (size > slot->pbo_size) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_STREAM_DRAW);
+        mem_track(MEM_BUFFER, slot->pbo, size, "staging buffer");
+        slot->pbo_size = size;
+    }
+    void *ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return (unsigned char *)ptr;
+}
+
+static bool
+upload_staging(IngestSlot *slot, PooledTexture **ptex)
+{
+    long t = get_time_usec();
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->pbo);
+    // the contents are undefined if it returns false, don't show them
+    bool res = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+    if (res && ptex) {
+        int w = slot->img.width;
+        int h = slot->img.height;
+        if ((res = (*ptex = tex_acquire(w, h, GL_RGBA8, 1)) != 0)) {
+            glBindTexture(GL_TEXTURE_2D, (*ptex)->tex);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+            ingest.upload_bytes += (long)w * h * 4;
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    ingest.upload_usec += get_time_usec() - t;
+    return res;
+}
+
+// Keeps INGEST_DEPTH images in flight: mapped and decoding on the workers,
+// while the oldest is waited for, uploaded and published. Frames are
+// published in file order, at -rate if given, as fast as possible if not.
+static void *
+ingest_thread(void *)
+{
+    eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx_angle.ctx);
+    mem_set_context("ctx_angle");
+
+    DecodePool pool;
+    IngestSlot slots[INGEST_DEPTH];
+    memset(slots, 0, sizeof slots);
+    int next_file = 0;
+    int submitted = 0, completed = 0;
+    bool quit = !decode_pool_init(&pool, opt_workers);
+
+    long interval = opt_rate ? 1000000 / opt_rate : 0;
+    long next = get_time_usec();
+
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+
+    while (!quit) {
+        while (submitted - completed < INGEST_DEPTH && next_file < num_images) {
+            IngestSlot *slot = slots + submitted % INGEST_DEPTH;
+            const char *fname = image_paths[next_file++];
+            if (!image_open(&slot->img, fname)) {
+                ingest.failed++;
+                continue;
+            }
+            if (slot->img.width > max_size || slot->img.height > max_size) {
+                fprintf(stderr, "%s: %dx%d is larger than the maximum texture size (%d).\n",
+                        fname, slot->img.width, slot->img.height, max_size);
+                image_close(&slot->img);
+                ingest.failed++;
+                continue;
+            }
+            if (!(slot->job.dst = map_staging(slot))) {
+                fprintf(stderr, "Failed to map a staging buffer.\n");
+                image_close(&slot->img);
+                ingest.failed++;
+                continue;
+            }
+            slot->job.img = &slot->img;
+            decode_submit(&pool, &slot->job);
+            submitted++;
+        }
+        if (completed == submitted)
+            break;
+
+        IngestSlot *slot = slots + completed++ % INGEST_DEPTH;
+        bool decoded = decode_wait(&pool, &slot->job);
+        if (!ingest.decode_start || slot->job.start_usec < ingest.decode_start)
+            ingest.decode_start = slot->job.start_usec;
+        if (slot->job.end_usec > ingest.decode_end)
+            ingest.decode_end = slot->job.end_usec;
+
+        if (interval) {
+            sleep_until_usec(next);
+            next += interval;
+            if (next < get_time_usec())
+                next = get_time_usec();
+        }
+
+        ContentFrame frame;
+        frame.content_usec = get_time_usec();
+        if (upload_staging(slot, decoded ? &frame.ptex : 0) && decoded) {
+            ingest.images++;
+            ingest.decode_bytes += (long)slot->img.width * slot->img.height * 4;
+            publish_frame(frame);
+        } else {
+            fprintf(stderr, "Failed to decode an image.\n");
+            ingest.failed++;
+        }
+        image_close(&slot->img);
+
+        pthread_mutex_lock(&frame_mutex);
+        quit = producer_quit;
+        pthread_mutex_unlock(&frame_mutex);
+    }
+
+    // the workers may still be writing to the mapped buffers
+    for (; completed < submitted; completed++) {
+        IngestSlot *slot = slots + completed % INGEST_DEPTH;
+        decode_wait(&pool, &slot->job);
+        upload_staging(slot, 0);
+        image_close(&slot->img);
+    }
+    if (pool.threads)
+        decode_pool_destroy(&pool);
+
+    for (int i = 0; i < INGEST_DEPTH; i++) {
+        if (slots[i].pbo) {
+            mem_untrack(MEM_BUFFER, slots[i].pbo);
+            glDeleteBuffers(1, &slots[i].pbo);
+        }
+    }
+
+    pthread_mutex_lock(&frame_mutex);
+    ingest_done = true;
+    pthread_mutex_unlock(&frame_mutex);
+
+    eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    return 0;
+}
+
+// the whole sequence was published, and the last frame was picked up
+static bool
+ingest_finished()
+{
+    pthread_mutex_lock(&frame_mutex);
+    bool res = ingest_done && !newest_frame.ptex;
+    pthread_mutex_unlock(&frame_mutex);
+    return res;
+}
+
+static void
+print_ingest_stats()
+{
+    fprintf(stderr, "ingest: %d images, %d failed, %d decode threads\n",
+            ingest.images, ingest.failed, opt_workers);
+    if (!ingest.images)
+        return;
+
+    double mb = ingest.decode_bytes / 1048576.0;
+    double decode_sec = (ingest.decode_end - ingest.decode_start) / 1000000.0;
+    double upload_sec = ingest.upload_usec / 1000000.0;
+    if (decode_sec > 0) {
+        fprintf(stderr, "  decode:  %8.1f images/s, %8.1f MB/s\n",
+                ingest.images / decode_sec, mb / decode_sec);
+    }
+    if (upload_sec > 0) {
+        fprintf(stderr, "  upload:  %8.1f images/s, %8.1f MB/s\n",
+                ingest.images / upload_sec, ingest.upload_bytes / 1048576.0 / upload_sec);
+    }
+    if (paced_usec > 0) {
+        fprintf(stderr, "  present: %8.1f frames/s\n",
+                pacing.presented / (paced_usec / 1000000.0));
+    }
+    // without -rate the images are published as soon as they're uploaded,
+    // and those replaced before a display tick are never shown
+    if (pacing.dropped) {
+        fprintf(stderr, "  dropped: %d images, not shown%s\n", pacing.dropped,
+                opt_rate ? "" : " (no -rate: published faster than presented)");
+    }
+}
+
+static void
+print_present_stats()
+{
+    if (!present_rounds)
+        return;
+
+    fprintf(stderr, "presentation: %d output(s), %s, %d frames\n", num_outputs,
+            opt_threads ? "one thread per output" : "round-robin", present_rounds);
+    fprintf(stderr, "  all outputs: %8.3f ms/frame, %8.3f ms max\n",
+            present_rounds_usec / 1000.0 / present_rounds, present_max_usec / 1000.0);
+    for (int i = 0; i < num_outputs; i++) {
+        Output *out = outputs + i;
+        if (!out->present_count)
+            continue;
+        fprintf(stderr, "  output %2d:   %8.3f ms/frame, %d partial, %d skipped\n", i,
+                out->present_usec / 1000.0 / out->present_count,
+                out->partial_count, out->skip_count);
+    }
+
+    if (opt_rate || opt_images)
+        pacing_print_stats(&pacing, stderr);
+    if (opt_images)
+        print_ingest_stats();
+
+    if (load_upload) {
+        TileUpload *up = load_upload;
+        fprintf(stderr, "upload: %d/%d tiles, %.2f MB in %d frames, %.3f ms, %.3f ms max per frame%s\n",
+                up->next, up->num_tiles, up->bytes / 1048576.0, up->frames,
+                up->usec / 1000.0, up->max_step_usec / 1000.0,
+                upload_done(up) ? "" : " (incomplete)");
+        if (upload_done(up))
+            fprintf(stderr, "  shown after %d frames\n", load_frames);
+    }
+
+    if (render_batches) {
+        fprintf(stderr, "render thread: %d commands in %d batches, %d resizes coalesced\n",
+                render_cmds, render_batches, render_resizes_dropped);
+    }
+
+    if (xev_batches) {
+        fprintf(stderr, "X events: %d in %d batches, %d configure and %d expose coalesced\n",
+                xev_count, xev_batches, xev_configure_merged, xev_expose_merged);
+    }
+
+    TexturePoolStats ts = tex_get_stats();
+    fprintf(stderr, "textures: %d created, %d recycled, %d peak\n",
+            ts.created, ts.reused, ts.peak_live);
+
+    if (opt_fbo) {
+        RenderTargetStats rts = rt_get_stats();
+        fprintf(stderr, "render targets: %d allocated, %d reused, %d destroyed, %d peak\n",
+                rts.allocated, rts.reused, rts.destroyed, rts.peak_live);
+    }
+
+    mem_print_stats(stderr);
+}
+
+// Estimate: color buffers (two for windows) plus the depth/stencil buffer.
+static long
+egl_surface_size(int w, int h, bool window)
+{
+    EGLint color_bits, depth_bits, stencil_bits;
+    eglGetConfigAttrib(egl_dpy, ctx_es.config, EGL_BUFFER_SIZE, &color_bits);
+    eglGetConfigAttrib(egl_dpy, ctx_es.config, EGL_DEPTH_SIZE, &depth_bits);
+    eglGetConfigAttrib(egl_dpy, ctx_es.config, EGL_STENCIL_SIZE, &stencil_bits);
+
+    long pixels = (long)w * h;
+    return pixels * (color_bits + 7) / 8 * (window ? 2 : 1) +
+        pixels * (depth_bits + stencil_bits + 7) / 8;
+}
+
+static void
+over_budget(long used, long budget, void *)
+{
+    fprintf(stderr, "GPU memory over budget: %.2f MB / %.2f MB\n",
+            used / 1048576.0, budget / 1048576.0);
+
+    // the pooled textures are shared, any context will do
+    if (eglGetCurrentContext() != EGL_NO_CONTEXT)
+        tex_pool_trim();
+}
+
+static void
+damage_output(Output *out, const Rect &r)
+{
+    pthread_mutex_lock(&present_mutex);
+    out->damage = rect_union(out->damage, r);
+    pthread_mutex_unlock(&present_mutex);
+}
+
+// Damage on the shared texture is kept in texture coordinates, and mapped
+// to each output when it's presented, with whatever size it has by then.
+static void
+damage_texture(const Rect &r)
+{
+    pthread_mutex_lock(&present_mutex);
+    for (int i = 0; i < num_outputs; i++) {
+        outputs[i].tex_damage = rect_union(outputs[i].tex_damage, r);
+    }
+    pthread_mutex_unlock(&present_mutex);
+}
+
+static void
+damage_all()
+{
+    pthread_mutex_lock(&present_mutex);
+    for (int i = 0; i < num_outputs; i++) {
+        Rect full = {0, 0, outputs[i].width, outputs[i].height};
+        outputs[i].damage = full;
+    }
+    pthread_mutex_unlock(&present_mutex);
+}
+
+static void
+display(Output *out)
+{
+    long t = get_time_usec();
+
+    // mapped is set by the render thread, and read here by the present threads
+    pthread_mutex_lock(&present_mutex);
+    if (!out->mapped) {
+        pthread_mutex_unlock(&present_mutex);
+        return;
+    }
+    Rect full = {0, 0, out->width, out->height};
+    Rect dmg = rect_scale(out->tex_damage, tex_width, tex_height, out->width, out->height);
+    dmg = rect_union(dmg, out->damage);
+    out->damage.width = out->damage.height = 0;
+    out->tex_damage.width = out->tex_damage.height = 0;
+    pthread_mutex_unlock(&present_mutex);
+
+    dmg = opt_nodamage ? full : rect_intersect(dmg, full);
+    if (rect_empty(dmg)) {
+        // nothing changed, nothing to present
+        out->skip_count++;
+        return;
+    }
+
     // make the EGL context current
-    eglMakeCurrent(egl_dpy, egl_surf, egl_surf, ctx_es.ctx);
+    if (!opt_threads) {
+        eglMakeCurrent(egl_dpy, out->surf, out->surf, out->ctx.ctx);
+        trace_make_current(TRACE_CTX_CONSUMER, out - outputs);
+    }
+
+    // whatever the back buffer missed since it was last presented, has to
+    // be repainted along with the new damage
+    EGLint age = 0;
+    if (egl_buffer_age && !opt_nodamage)
+        eglQuerySurface(egl_dpy, out->surf, EGL_BUFFER_AGE_EXT, &age);
+    Rect repaint = damage_for_age(&out->damage_hist, dmg, age, full);
+    damage_push(&out->damage_hist, dmg);
+
+    // resizes within the same size class keep the same target, others are
+    // picked from the pool, if the size was used recently
+    if (opt_fbo) {
+        RenderTarget *rt = out->rt;
+        if (!rt || rt->width != full.width || rt->height != full.height) {
+            rt_release(rt);
+            out->rt = rt_acquire(full.width, full.height, GL_RGBA8, 0);
+        }
+        rt_collect(RT_GRACE_USEC);
+    }
+
+    bool partial = repaint.width != full.width || repaint.height != full.height;
+    if (partial) {
+        if (egl_set_damage_region) {
+            EGLint rect[] = {repaint.x, repaint.y, repaint.width, repaint.height};
+            egl_set_damage_region(egl_dpy, out->surf, rect, 1);
+        }
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(repaint.x, repaint.y, repaint.width, repaint.height);
+        trace_scissor(true, repaint.x, repaint.y, repaint.width, repaint.height);
+        out->partial_count++;
+    }
+
+    // in round-robin all outputs share the context and its viewport
+    glViewport(0, 0, full.width, full.height);
+    trace_viewport(0, 0, full.width, full.height);
+    if (out->rt)
+        glBindFramebuffer(GL_FRAMEBUFFER, out->rt->fbo);
 
     glClear(GL_COLOR_BUFFER_BIT);
+    trace_clear(GL_COLOR_BUFFER_BIT);
 	bind_program(gl_prog);
-	glBindTexture(GL_TEXTURE_2D, gl_tex);
+	glBindTexture(GL_TEXTURE_2D, gl_tex->tex);
 	glBindBuffer(GL_ARRAY_BUFFER, gl_vbo);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(shaders::attrib::vertex, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(shaders::attrib::vertex);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    trace_draw(gl_prog, gl_tex->tex, gl_vbo, GL_TRIANGLE_STRIP, 4);
 
-    eglSwapBuffers(egl_dpy, egl_surf);
+    if (out->rt) {
+        int x1 = repaint.x + repaint.width;
+        int y1 = repaint.y + repaint.height;
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, out->rt->fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(repaint.x, repaint.y, x1, y1, repaint.x, repaint.y, x1, y1,
+                GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    if (partial) {
+        glDisable(GL_SCISSOR_TEST);
+        trace_scissor(false, 0, 0, 0, 0);
+    }
+
+    if (egl_swap_buffers_with_damage && !opt_nodamage) {
+        EGLint rect[] = {dmg.x, dmg.y, dmg.width, dmg.height};
+        egl_swap_buffers_with_damage(egl_dpy, out->surf, rect, 1);
+    } else {
+        eglSwapBuffers(egl_dpy, out->surf);
+    }
+    trace_swap(out - outputs);
+
+    out->present_usec += get_time_usec() - t;
+    out->present_count++;
+
+    // each output is presented by one thread only
+    if (out->present_count == 1) {
+        fprintf(stderr, "%s: time to first frame: %.3f ms\n", out->name,
+                (get_time_usec() - startup_start) / 1000.0);
+    }
 
     // make the angle context current
 }
 
 static void
-reshape(int w, int h)
+reshape(Output *out, int w, int h)
 {
-	glViewport(0, 0, w, h);
+    // the viewport is set by whichever context presents to the output
+    pthread_mutex_lock(&present_mutex);
+    out->width = w;
+    out->height = h;
+    Rect full = {0, 0, w, h};
+    out->damage = full;
+    pthread_mutex_unlock(&present_mutex);
+
+    mem_track(MEM_SURFACE, (unsigned long)out->surf, egl_surface_size(w, h, true),
+            "window surface");
 }
 
 static bool
@@ -0,0 +1,257 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#include <GLES3/gl32.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memacct.h"
+
+struct mem_group {
+	const char *ctx;
+	const char *purpose;
+	long bytes, peak;
+	int count;
+	struct mem_group *next;
+};
+
+struct mem_object {
+	int type;
+	unsigned long id;
+	long bytes;
+	struct mem_group *group;
+	struct mem_object *next;
+};
+
+static pthread_mutex_t mem_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct mem_group *groups;
+static struct mem_object *objects;
+static long used, peak;
+
+static long budget;
+static mem_budget_func budget_func;
+static void *budget_cls;
+
+static __thread const char *cur_ctx = "none";
+
+void mem_set_context(const char *name)
+{
+	cur_ctx = name ? name : "none";
+}
+
+/* tags are expected to be string literals, compare by content anyway */
+static struct mem_group *get_group(const char *ctx, const char *purpose)
+{
+	struct mem_group *g;
+
+	for(g = groups; g; g = g->next) {
+		if(strcmp(g->ctx, ctx) == 0 && strcmp(g->purpose, purpose) == 0) {
+			return g;
+		}
+	}
+	if(!(g = calloc(1, sizeof *g))) {
+		return 0;
+	}
+	g->ctx = ctx;
+	g->purpose = purpose;
+	g->next = groups;
+	groups = g;
+	return g;
+}
+
+static struct mem_object **find_object(int type, unsigned long id)
+{
+	struct mem_object **prev = &objects;
+
+	while(*prev) {
+		if((*prev)->type == type && (*prev)->id == id) {
+			break;
+		}
+		prev = &(*prev)->next;
+	}
+	return prev;
+}
+
+void mem_track(int type, unsigned long id, long bytes, const char *purpose)
+{
+	struct mem_object *obj;
+	long delta, total;
+	int over = 0;
+
+	pthread_mutex_lock(&mem_mutex);
+	if(!(obj = *find_object(type, id))) {
+		if(!(obj = calloc(1, sizeof *obj)) || !(obj->group = get_group(cur_ctx, purpose))) {
+			free(obj);
+			pthread_mutex_unlock(&mem_mutex);
+			return;
+		}
+		obj->type = type;
+		obj->id = id;
+		obj->next = objects;
+		objects = obj;
+		obj->group->count++;
+	}
+
+	delta = bytes - obj->bytes;
+	obj->bytes = bytes;
+	obj->group->bytes += delta;
+	if(obj->group->bytes > obj->group->peak) {
+		obj->group->peak = obj->group->bytes;
+	}
+	used += delta;
+	if(used > peak) {
+		peak = used;
+	}
+	total = used;
+	over = budget > 0 && delta > 0 && used > budget;
+	pthread_mutex_unlock(&mem_mutex);
+
+	if(over && budget_func) {
+		budget_func(total, budget, budget_cls);
+	}
+}
+
+void mem_untrack(int type, unsigned long id)
+{
+	struct mem_object **prev, *obj;
+
+	pthread_mutex_lock(&mem_mutex);
+	prev = find_object(type, id);
+	if((obj = *prev)) {
+		*prev = obj->next;
+		obj->group->bytes -= obj->bytes;
+		obj->group->count--;
+		used -= obj->bytes;
+		free(obj);
+	}
+	pthread_mutex_unlock(&mem_mutex);
+}
+
+void mem_set_budget(long bytes, mem_budget_func func, void *cls)
+{
+	pthread_mutex_lock(&mem_mutex);
+	budget = bytes;
+	budget_func = func;
+	budget_cls = cls;
+	pthread_mutex_unlock(&mem_mutex);
+}
+
+long mem_used(void)
+{
+	long res;
+	pthread_mutex_lock(&mem_mutex);
+	res = used;
+	pthread_mutex_unlock(&mem_mutex);
+	return res;
+}
+
+long mem_peak(void)
+{
+	long res;
+	pthread_mutex_lock(&mem_mutex);
+	res = peak;
+	pthread_mutex_unlock(&mem_mutex);
+	return res;
+}
+
+int mem_format_size(unsigned int format)
+{
+	switch(format) {
+	case GL_R8:
+		return 1;
+	case GL_RG8:
+	case GL_R16F:
+	case GL_RGB565:
+	case GL_RGBA4:
+	case GL_RGB5_A1:
+	case GL_DEPTH_COMPONENT16:
+		return 2;
+	case GL_RGB8:
+	case GL_DEPTH_COMPONENT24:
+		return 3;
+	case GL_RGBA8:
+	case GL_SRGB8_ALPHA8:
+	case GL_RGB10_A2:
+	case GL_R32F:
+	case GL_RG16F:
+	case GL_DEPTH24_STENCIL8:
+	case GL_DEPTH_COMPONENT32F:
+		return 4;
+	case GL_RGBA16F:
+	case GL_RG32F:
+		return 8;
+	case GL_RGBA32F:
+		return 16;
+	default:
+		break;
+	}
+	return 0;
+}
+
+long mem_texture_size(int width, int height, unsigned int format, int levels)
+{
+	long size = 0;
+	int i, bpp = mem_format_size(format);
+
+	for(i=0; i<levels; i++) {
+		size += (long)width * height * bpp;
+		if(width > 1) width /= 2;
+		if(height > 1) height /= 2;
+	}
+	return size;
+}
+
+static const char *typestr[] = {"texture", "buffer", "renderbuffer", "surface"};
+
+void mem_print_stats(FILE *fp)
+{
+	struct mem_group *g;
+	struct mem_object *obj;
+	long type_bytes[NUM_MEM_TYPES] = {0};
+	int i;
+
+	pthread_mutex_lock(&mem_mutex);
+	for(obj = objects; obj; obj = obj->next) {
+		type_bytes[obj->type] += obj->bytes;
+	}
+
+	fprintf(fp, "GPU memory: %.2f MB in use, %.2f MB peak", used / 1048576.0, peak / 1048576.0);
+	if(budget > 0) {
+		fprintf(fp, ", %.2f MB budget", budget / 1048576.0);
+	}
+	fputc('\n', fp);
+	for(i=0; i<NUM_MEM_TYPES; i++) {
+		if(type_bytes[i]) {
+			fprintf(fp, "  %-14s %10.2f MB\n", typestr[i], type_bytes[i] / 1048576.0);
+		}
+	}
+	for(g = groups; g; g = g->next) {
+		fprintf(fp, "  %-10s %-18s %4d objects %10.2f MB, peak %10.2f MB\n", g->ctx,
+				g->purpose, g->count, g->bytes / 1048576.0, g->peak / 1048576.0);
+	}
+	pthread_mutex_unlock(&mem_mutex);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#ifndef MEMACCT_H
+#define MEMACCT_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Estimated GPU memory of every object created through the shctx helpers,
+ * grouped by the context that created it and by purpose. */
+
+enum {
+    MEM_TEXTURE,
+    MEM_BUFFER,
+    MEM_RENDERBUFFER,
+    MEM_SURFACE,
+
+    NUM_MEM_TYPES
+};
+
+/* name of the context current in the calling thread, used to tag the
+ * objects it creates */
+void mem_set_context(const char *name);
+
+/* records an object, or updates its size if it's already tracked */
+void mem_track(int type, unsigned long id, long bytes, const char *purpose);
+void mem_untrack(int type, unsigned long id);
+
+/* the callback is called (outside any lock) every time an allocation
+ * pushes the total above the budget, and can free memory. 0 means no budget */
+typedef void (*mem_budget_func)(long used, long budget, void *cls);
+void mem_set_budget(long bytes, mem_budget_func func, void *cls);
+
+long mem_used(void);
+long mem_peak(void);
+
+/* bytes per pixel of a sized internal format, 0 if unknown */
+int mem_format_size(unsigned int format);
+long mem_texture_size(int width, int height, unsigned int format, int levels);
+
+void mem_print_stats(FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MEMACCT_H
@@ -0,0 +1,71 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#include <stdlib.h>
+
+#include "pacing.h"
+
+void
+pacing_frame_presented(PacingStats *st, long content_usec, long swap_usec)
+{
+    long latency = swap_usec - content_usec;
+    if (!st->presented || latency < st->latency_min)
+        st->latency_min = latency;
+    if (latency > st->latency_max)
+        st->latency_max = latency;
+    st->latency_sum += latency;
+
+    if (st->presented) {
+        long judder = labs((swap_usec - st->last_swap_usec) -
+                (content_usec - st->last_content_usec));
+        if (judder > st->judder_max)
+            st->judder_max = judder;
+        st->judder_sum += judder;
+        st->judder_count++;
+    }
+
+    st->last_content_usec = content_usec;
+    st->last_swap_usec = swap_usec;
+    st->presented++;
+}
+
+void
+pacing_print_stats(const PacingStats *st, FILE *fp)
+{
+    fprintf(fp, "pacing: %d frames produced, %d presented, %d dropped, "
+            "%d ticks repeated, %d ticks late\n", st->produced, st->presented,
+            st->dropped, st->repeated, st->late_ticks);
+    if (!st->presented)
+        return;
+
+    fprintf(fp, "  latency: %8.3f ms min, %8.3f ms mean, %8.3f ms max\n",
+            st->latency_min / 1000.0, st->latency_sum / 1000.0 / st->presented,
+            st->latency_max / 1000.0);
+    if (st->judder_count) {
+        fprintf(fp, "  judder:  %8.3f ms mean, %8.3f ms max\n",
+                st->judder_sum / 1000.0 / st->judder_count, st->judder_max / 1000.0);
+    }
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#ifndef PACING_H
+#define PACING_H
+
+#include <stdio.h>
+
+// Frames produced at the content rate and presented at the display rate.
+// Latency is from the content timestamp of a frame to the end of the swap
+// that showed it. Judder is how much the time between showing two frames
+// differs from the time between their content timestamps: zero when the
+// motion on screen keeps the pace of the content.
+struct PacingStats {
+    int produced;
+    int dropped;        // replaced by a newer frame before it was shown
+    int presented;
+    int repeated;       // display ticks without a new frame
+    int late_ticks;     // display ticks missed altogether
+
+    long latency_sum, latency_min, latency_max;
+    long judder_sum, judder_max;
+    int judder_count;
+
+    long last_content_usec, last_swap_usec;
+};
+
+void pacing_frame_presented(PacingStats *st, long content_usec, long swap_usec);
+void pacing_print_stats(const PacingStats *st, FILE *fp);
+
+#endif //PACING_H
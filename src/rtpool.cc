@@ -0,0 +1,205 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "memacct.h"
+#include "rtpool.h"
+#include "timer.h"
+
+// sizes are rounded up to multiples of this
+#define SIZE_CLASS_STEP 256
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static RenderTarget *pool;
+static RenderTargetStats stats;
+
+static int
+size_class(int sz)
+{
+    return (sz + SIZE_CLASS_STEP - 1) / SIZE_CLASS_STEP * SIZE_CLASS_STEP;
+}
+
+static void
+rt_destroy(RenderTarget *rt)
+{
+    mem_untrack(MEM_TEXTURE, rt->tex);
+    glDeleteFramebuffers(1, &rt->fbo);
+    glDeleteTextures(1, &rt->tex);
+    if (rt->depth_rbo) {
+        mem_untrack(MEM_RENDERBUFFER, rt->depth_rbo);
+        glDeleteRenderbuffers(1, &rt->depth_rbo);
+    }
+    free(rt);
+}
+
+static RenderTarget *
+rt_create(int alloc_w, int alloc_h, GLenum format, GLenum depth_format)
+{
+    RenderTarget *rt = (RenderTarget *)calloc(1, sizeof *rt);
+    if (!rt)
+        return 0;
+
+    rt->alloc_width = alloc_w;
+    rt->alloc_height = alloc_h;
+    rt->format = format;
+    rt->depth_format = depth_format;
+    rt->ctx = eglGetCurrentContext();
+
+    glGenTextures(1, &rt->tex);
+    glBindTexture(GL_TEXTURE_2D, rt->tex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, format, alloc_w, alloc_h);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &rt->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, rt->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rt->tex, 0);
+
+    if (depth_format) {
+        glGenRenderbuffers(1, &rt->depth_rbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, rt->depth_rbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, depth_format, alloc_w, alloc_h);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rt->depth_rbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    mem_track(MEM_TEXTURE, rt->tex, mem_texture_size(alloc_w, alloc_h, format, 1),
+            "render target");
+    if (depth_format) {
+        mem_track(MEM_RENDERBUFFER, rt->depth_rbo,
+                mem_texture_size(alloc_w, alloc_h, depth_format, 1), "render target");
+    }
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Incomplete %dx%d render target (0x%x).\n", alloc_w, alloc_h, status);
+        rt_destroy(rt);
+        return 0;
+    }
+    return rt;
+}
+
+RenderTarget *
+rt_acquire(int width, int height, GLenum format, GLenum depth_format)
+{
+    int alloc_w = size_class(width);
+    int alloc_h = size_class(height);
+    EGLContext ctx = eglGetCurrentContext();
+
+    pthread_mutex_lock(&pool_mutex);
+    RenderTarget *prev = 0;
+    for (RenderTarget *rt = pool; rt; rt = rt->next) {
+        if (rt->ctx == ctx && rt->alloc_width == alloc_w && rt->alloc_height == alloc_h &&
+                rt->format == format && rt->depth_format == depth_format) {
+            if (prev)
+                prev->next = rt->next;
+            else
+                pool = rt->next;
+            stats.reused++;
+            pthread_mutex_unlock(&pool_mutex);
+
+            rt->next = 0;
+            rt->width = width;
+            rt->height = height;
+            return rt;
+        }
+        prev = rt;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    RenderTarget *rt = rt_create(alloc_w, alloc_h, format, depth_format);
+    if (!rt)
+        return 0;
+    rt->width = width;
+    rt->height = height;
+
+    pthread_mutex_lock(&pool_mutex);
+    stats.allocated++;
+    if (++stats.live > stats.peak_live)
+        stats.peak_live = stats.live;
+    pthread_mutex_unlock(&pool_mutex);
+    return rt;
+}
+
+void
+rt_release(RenderTarget *rt)
+{
+    if (!rt)
+        return;
+
+    rt->release_time = get_time_usec();
+
+    pthread_mutex_lock(&pool_mutex);
+    rt->next = pool;
+    pool = rt;
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+void
+rt_collect(long grace_usec)
+{
+    EGLContext ctx = eglGetCurrentContext();
+    long now = get_time_usec();
+    RenderTarget *expired = 0;
+
+    pthread_mutex_lock(&pool_mutex);
+    RenderTarget **prev = &pool;
+    while (*prev) {
+        RenderTarget *rt = *prev;
+        if (rt->ctx == ctx && now - rt->release_time >= grace_usec) {
+            *prev = rt->next;
+            rt->next = expired;
+            expired = rt;
+            stats.destroyed++;
+            stats.live--;
+        } else {
+            prev = &rt->next;
+        }
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    // GL calls outside the lock, other contexts may be using the pool
+    while (expired) {
+        RenderTarget *rt = expired;
+        expired = expired->next;
+        rt_destroy(rt);
+    }
+}
+
+RenderTargetStats
+rt_get_stats()
+{
+    pthread_mutex_lock(&pool_mutex);
+    RenderTargetStats res = stats;
+    pthread_mutex_unlock(&pool_mutex);
+    return res;
+}
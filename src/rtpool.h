@@ -0,0 +1,76 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#ifndef RTPOOL_H
+#define RTPOOL_H
+
+#include <EGL/egl.h>
+#include <GLES3/gl32.h>
+
+// Offscreen render targets, bucketed by size class and format so that a
+// resize which stays in the same class reuses the same target. Released
+// targets stay in the pool for a grace period, in case the size comes back
+// (interactive resizing), before they are destroyed.
+//
+// Framebuffer objects aren't shared between contexts, so every target
+// belongs to the context that was current when it was created, and is only
+// handed out to that context again.
+struct RenderTarget {
+    GLuint fbo;
+    GLuint tex;
+    GLuint depth_rbo;
+
+    // requested size, and the size class that was allocated
+    int width, height;
+    int alloc_width, alloc_height;
+    GLenum format;
+    GLenum depth_format;
+
+    EGLContext ctx;
+    long release_time;
+    RenderTarget *next;
+};
+
+struct RenderTargetStats {
+    int allocated;
+    int reused;
+    int destroyed;
+    int live;
+    int peak_live;
+};
+
+// depth_format 0 means no depth buffer
+RenderTarget *rt_acquire(int width, int height, GLenum format, GLenum depth_format);
+void rt_release(RenderTarget *rt);
+// destroys the released targets of the current context which have not been
+// used for grace_usec microseconds (all of them for 0)
+void rt_collect(long grace_usec);
+
+RenderTargetStats rt_get_stats();
+
+#define RT_GRACE_USEC 2000000
+
+#endif //RTPOOL_H
@@ -12,6 +12,7 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <pthread.h>
 
 #if defined(unix) || defined(__unix__)
 #include <unistd.h>
@@ -19,9 +20,13 @@
 #endif	/* unix */
 
 #include "sdr.h"
+#include "memacct.h"
 
 static const char *sdrtypestr(unsigned int sdrtype);
 static int sdrtypeidx(unsigned int sdrtype);
+static void bind_uniform_blocks(unsigned int prog);
+static char *defines_text(const char *defs);
+static char *variant_key(char kind, const char *vstr, const char *pstr, const char *defs);
 
 
 unsigned int create_vertex_shader(const char *src)
@@ -61,30 +66,64 @@ unsigned int create_geometry_shader(const char *src)
 #endif
 }
 
+unsigned int create_compute_shader(const char *src)
+{
+#ifdef GL_COMPUTE_SHADER
+	return create_shader(src, GL_COMPUTE_SHADER);
+#else
+	return 0;
+#endif
+}
+
 unsigned int create_shader(const char *src, unsigned int sdr_type)
+{
+	return create_shader_defs(src, sdr_type, 0);
+}
+
+unsigned int create_shader_defs(const char *src, unsigned int sdr_type, const char *defs)
 {
 	unsigned int sdr;
 	int success, info_len;
-	char *info_str = 0;
-	const char *src_str[3], *header, *footer;
+	char *info_str = 0, *defs_str = 0;
+	const char *src_str[5], *header, *footer, *ver;
+	int src_len[5];
 	int src_str_count = 0;
 	GLenum err;
 
+	/* the #version directive must come first, so anything we prepend has
+	 * to go after it, if the shader has one */
+	ver = src;
+	while(*ver == ' ' || *ver == '\t' || *ver == '\r' || *ver == '\n') ver++;
+	if(strncmp(ver, "#version", 8) == 0) {
+		const char *endl = strchr(ver, '\n');
+		src_str[src_str_count] = src;
+		src_len[src_str_count++] = endl ? endl - src + 1 : (int)strlen(src);
+		src += src_len[src_str_count - 1];
+	}
+
+	if((defs_str = defines_text(defs))) {
+		src_str[src_str_count] = defs_str;
+		src_len[src_str_count++] = -1;
+	}
 	if((header = get_shader_header(sdr_type))) {
-		src_str[src_str_count++] = header;
+		src_str[src_str_count] = header;
+		src_len[src_str_count++] = -1;
 	}
-	src_str[src_str_count++] = src;
+	src_str[src_str_count] = src;
+	src_len[src_str_count++] = -1;
 	if((footer = get_shader_footer(sdr_type))) {
-		src_str[src_str_count++] = footer;
+		src_str[src_str_count] = footer;
+		src_len[src_str_count++] = -1;
 	}
 
 	sdr = glCreateShader(sdr_type);
 	assert(glGetError() == GL_NO_ERROR);
-	glShaderSource(sdr, src_str_count, src_str, 0);
+	glShaderSource(sdr, src_str_count, src_str, src_len);
 	err = glGetError();
 	assert(err == GL_NO_ERROR);
 	glCompileShader(sdr);
 	assert(glGetError() == GL_NO_ERROR);
+	free(defs_str);
 
 	glGetShaderiv(sdr, GL_COMPILE_STATUS, &success);
 	assert(glGetError() == GL_NO_ERROR);
@@ -153,7 +192,21 @@ unsigned int load_geometry_shader(const char *fname)
 #endif
 }
 
+unsigned int load_compute_shader(const char *fname)
+{
+#ifdef GL_COMPUTE_SHADER
+	return load_shader(fname, GL_COMPUTE_SHADER);
+#else
+	return 0;
+#endif
+}
+
 unsigned int load_shader(const char *fname, unsigned int sdr_type)
+{
+	return load_shader_defs(fname, sdr_type, 0);
+}
+
+unsigned int load_shader_defs(const char *fname, unsigned int sdr_type, const char *defs)
 {
 	unsigned int sdr;
 	size_t filesize;
@@ -177,8 +230,12 @@ unsigned int load_shader(const char *fname, unsigned int sdr_type)
 	src[filesize] = 0;
 	fclose(fp);
 
-	fprintf(stderr, "compiling %s shader: %s... ", sdrtypestr(sdr_type), fname);
-	sdr = create_shader(src, sdr_type);
+	if(defs && *defs) {
+		fprintf(stderr, "compiling %s shader: %s [%s]... ", sdrtypestr(sdr_type), fname, defs);
+	} else {
+		fprintf(stderr, "compiling %s shader: %s... ", sdrtypestr(sdr_type), fname);
+	}
+	sdr = create_shader_defs(src, sdr_type, defs);
 
 	free(src);
 	return sdr;
@@ -237,6 +294,18 @@ unsigned int create_program_load(const char *vfile, const char *pfile)
 	return create_program_link(vs, ps, 0);
 }
 
+unsigned int create_compute_program_load(const char *cfile)
+{
+	unsigned int cs, prog;
+
+	if(!(cs = load_compute_shader(cfile))) {
+		return 0;
+	}
+	prog = create_program_link(cs, 0);
+	free_shader(cs);
+	return prog;
+}
+
 void free_program(unsigned int sdr)
 {
 	glDeleteProgram(sdr);
@@ -278,6 +347,7 @@ int link_program(unsigned int prog)
 
 	if(linked) {
 		fprintf(stderr, info_str ? "linking done: %s\n" : "linking done\n", info_str);
+		bind_uniform_blocks(prog);
 	} else {
 		fprintf(stderr, info_str ? "linking failed: %s\n" : "linking failed\n", info_str);
 		retval = -1;
@@ -413,13 +483,483 @@ void set_attrib_float3(int attr_loc, float x, float y, float z)
 	glVertexAttrib3f(attr_loc, x, y, z);
 }
 
+/* ---- uniform blocks ---- */
+struct uniform_block {
+	char *name;
+	unsigned int binding;
+	struct uniform_block *next;
+};
+
+static struct uniform_block *ublocks;
+
+void add_uniform_block(const char *name, unsigned int binding)
+{
+	struct uniform_block *ub;
+	int len = strlen(name);
+
+	if(!(ub = malloc(sizeof *ub)) || !(ub->name = malloc(len + 1))) {
+		fprintf(stderr, "failed to add uniform block: %s\n", name);
+		abort();
+	}
+	memcpy(ub->name, name, len + 1);
+	ub->binding = binding;
+	ub->next = ublocks;
+	ublocks = ub;
+}
+
+void clear_uniform_blocks(void)
+{
+	while(ublocks) {
+		struct uniform_block *ub = ublocks;
+		ublocks = ublocks->next;
+		free(ub->name);
+		free(ub);
+	}
+}
+
+static void bind_uniform_blocks(unsigned int prog)
+{
+	struct uniform_block *ub = ublocks;
+	while(ub) {
+		set_uniform_block_binding(prog, ub->name, ub->binding);
+		ub = ub->next;
+	}
+}
+
+int set_uniform_block_binding(unsigned int prog, const char *name, unsigned int binding)
+{
+	unsigned int idx = glGetUniformBlockIndex(prog, name);
+	if(idx == GL_INVALID_INDEX) {
+		return -1;
+	}
+	glUniformBlockBinding(prog, idx, binding);
+	return glGetError() == GL_NO_ERROR ? 0 : -1;
+}
+
+int get_uniform_block_size(unsigned int prog, const char *name)
+{
+	int size;
+	unsigned int idx = glGetUniformBlockIndex(prog, name);
+	if(idx == GL_INVALID_INDEX) {
+		return -1;
+	}
+	glGetActiveUniformBlockiv(prog, idx, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+	return size;
+}
+
+unsigned int create_uniform_buffer(unsigned int binding, int size)
+{
+	unsigned int ubo;
+
+	glGenBuffers(1, &ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, size, 0, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	if(glGetError() != GL_NO_ERROR) {
+		fprintf(stderr, "failed to create uniform buffer of size %d at binding %u\n", size, binding);
+		glDeleteBuffers(1, &ubo);
+		return 0;
+	}
+	mem_track(MEM_BUFFER, ubo, size, "uniform buffer");
+	return ubo;
+}
+
+void free_uniform_buffer(unsigned int ubo)
+{
+	mem_untrack(MEM_BUFFER, ubo);
+	glDeleteBuffers(1, &ubo);
+}
+
+int update_uniform_buffer(unsigned int ubo, int offs, int size, const void *data)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, offs, size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	return glGetError() == GL_NO_ERROR ? 0 : -1;
+}
+
+/* ---- separable programs ---- */
+unsigned int create_stage_program(unsigned int sdr)
+{
+	unsigned int prog;
+
+	if(!sdr || !(prog = create_program())) {
+		return 0;
+	}
+	glProgramParameteri(prog, GL_PROGRAM_SEPARABLE, GL_TRUE);
+	attach_shader(prog, sdr);
+	if(link_program(prog) == -1) {
+		free_program(prog);
+		return 0;
+	}
+	/* the shader isn't needed after linking */
+	glDetachShader(prog, sdr);
+	return prog;
+}
+
+unsigned int load_stage_program(const char *fname, unsigned int sdr_type)
+{
+	unsigned int sdr, prog;
+
+	if(!(sdr = load_shader(fname, sdr_type))) {
+		return 0;
+	}
+	prog = create_stage_program(sdr);
+	free_shader(sdr);
+	return prog;
+}
+
+struct program_pipeline {
+	const void *ctx;
+	unsigned int vprog, pprog;
+	unsigned int pipeline;
+	struct program_pipeline *next;
+};
+
+static struct program_pipeline *pipelines;
+static pthread_mutex_t pipelines_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int get_program_pipeline_locked(const void *ctx, unsigned int vprog, unsigned int pprog)
+{
+	struct program_pipeline *pp;
+
+	for(pp = pipelines; pp; pp = pp->next) {
+		if(pp->ctx == ctx && pp->vprog == vprog && pp->pprog == pprog) {
+			return pp->pipeline;
+		}
+	}
+
+	if(!(pp = malloc(sizeof *pp))) {
+		return 0;
+	}
+	glGenProgramPipelines(1, &pp->pipeline);
+	if(vprog) {
+		glUseProgramStages(pp->pipeline, GL_VERTEX_SHADER_BIT, vprog);
+	}
+	if(pprog) {
+		glUseProgramStages(pp->pipeline, GL_FRAGMENT_SHADER_BIT, pprog);
+	}
+	if(glGetError() != GL_NO_ERROR) {
+		fprintf(stderr, "failed to create pipeline with stage programs %u, %u\n", vprog, pprog);
+		glDeleteProgramPipelines(1, &pp->pipeline);
+		free(pp);
+		return 0;
+	}
+
+	pp->ctx = ctx;
+	pp->vprog = vprog;
+	pp->pprog = pprog;
+	pp->next = pipelines;
+	pipelines = pp;
+	return pp->pipeline;
+}
+
+unsigned int get_program_pipeline(const void *ctx, unsigned int vprog, unsigned int pprog)
+{
+	unsigned int pipeline;
+
+	pthread_mutex_lock(&pipelines_lock);
+	pipeline = get_program_pipeline_locked(ctx, vprog, pprog);
+	pthread_mutex_unlock(&pipelines_lock);
+	return pipeline;
+}
+
+int bind_program_pipeline(unsigned int pipeline)
+{
+	glUseProgram(0);
+	glBindProgramPipeline(pipeline);
+	return glGetError() == GL_NO_ERROR ? 0 : -1;
+}
+
+void free_program_pipelines(const void *ctx)
+{
+	struct program_pipeline **prev;
+
+	pthread_mutex_lock(&pipelines_lock);
+	prev = &pipelines;
+	while(*prev) {
+		struct program_pipeline *pp = *prev;
+		if(pp->ctx == ctx) {
+			*prev = pp->next;
+			glDeleteProgramPipelines(1, &pp->pipeline);
+			free(pp);
+		} else {
+			prev = &pp->next;
+		}
+	}
+	pthread_mutex_unlock(&pipelines_lock);
+}
+
+/* ---- compute ---- */
+int dispatch_compute(unsigned int prog, int width, int height, int depth)
+{
+#ifdef GL_COMPUTE_SHADER
+	int lsz[3];
+
+	glGetProgramiv(prog, GL_COMPUTE_WORK_GROUP_SIZE, lsz);
+	if(glGetError() != GL_NO_ERROR) {
+		return -1;
+	}
+	return dispatch_compute_groups(prog, (width + lsz[0] - 1) / lsz[0],
+			(height + lsz[1] - 1) / lsz[1], (depth + lsz[2] - 1) / lsz[2]);
+#else
+	return -1;
+#endif
+}
+
+int dispatch_compute_groups(unsigned int prog, int xgroups, int ygroups, int zgroups)
+{
+#ifdef GL_COMPUTE_SHADER
+	if(bind_program(prog) == -1) {
+		return -1;
+	}
+	glDispatchCompute(xgroups, ygroups, zgroups);
+	return glGetError() == GL_NO_ERROR ? 0 : -1;
+#else
+	return -1;
+#endif
+}
+
+/* ---- program variants ---- */
+struct program_variant {
+	char *key;
+	unsigned int prog;
+	struct program_variant *next;
+};
+
+static struct program_variant *variants;
+/* held while compiling too, so that two threads asking for the same
+ * variant don't both compile it */
+static pthread_mutex_t variants_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* vstr and pstr are file names, or the sources if is_src is set */
+static unsigned int get_program_variant_locked(const char *vstr, const char *pstr, int is_src, const char *defs)
+{
+	unsigned int vs = 0, ps = 0, prog;
+	struct program_variant *pv;
+	char *key;
+
+	if(!(key = variant_key(is_src ? 's' : 'f', vstr, pstr, defs))) {
+		return 0;
+	}
+	for(pv = variants; pv; pv = pv->next) {
+		if(strcmp(pv->key, key) == 0) {
+			free(key);
+			return pv->prog;
+		}
+	}
+
+	if(vstr && *vstr && !(vs = is_src ? create_shader_defs(vstr, GL_VERTEX_SHADER, defs) :
+				load_shader_defs(vstr, GL_VERTEX_SHADER, defs))) {
+		free(key);
+		return 0;
+	}
+	if(pstr && *pstr && !(ps = is_src ? create_shader_defs(pstr, GL_FRAGMENT_SHADER, defs) :
+				load_shader_defs(pstr, GL_FRAGMENT_SHADER, defs))) {
+		free_shader(vs);
+		free(key);
+		return 0;
+	}
+	prog = create_program_link(vs, ps, 0);
+	/* the program keeps the shaders alive as long as they're attached */
+	free_shader(vs);
+	free_shader(ps);
+
+	if(!prog || !(pv = malloc(sizeof *pv))) {
+		free_program(prog);
+		free(key);
+		return 0;
+	}
+	pv->key = key;
+	pv->prog = prog;
+	pv->next = variants;
+	variants = pv;
+	return prog;
+}
+
+unsigned int get_program_variant(const char *vfile, const char *pfile, const char *defs)
+{
+	unsigned int prog;
+
+	pthread_mutex_lock(&variants_lock);
+	prog = get_program_variant_locked(vfile, pfile, 0, defs);
+	pthread_mutex_unlock(&variants_lock);
+	return prog;
+}
+
+unsigned int get_program_variant_src(const char *vsrc, const char *psrc, const char *defs)
+{
+	unsigned int prog;
+
+	pthread_mutex_lock(&variants_lock);
+	prog = get_program_variant_locked(vsrc, psrc, 1, defs);
+	pthread_mutex_unlock(&variants_lock);
+	return prog;
+}
+
+int warmup_program_variants(const char *vfile, const char *pfile, const char **defs, int count)
+{
+	int i, nfailed = 0;
+
+	for(i=0; i<count; i++) {
+		if(!get_program_variant(vfile, pfile, defs[i])) {
+			nfailed++;
+		}
+	}
+	return nfailed;
+}
+
+int warmup_program_variants_src(const char *vsrc, const char *psrc, const char **defs, int count)
+{
+	int i, nfailed = 0;
+
+	for(i=0; i<count; i++) {
+		if(!get_program_variant_src(vsrc, psrc, defs[i])) {
+			nfailed++;
+		}
+	}
+	return nfailed;
+}
+
+char *shader_source_defs(const char *src, const char *defs)
+{
+	char *defs_str, *res;
+	const char *ver;
+	int ver_len = 0;
+
+	ver = src;
+	while(*ver == ' ' || *ver == '\t' || *ver == '\r' || *ver == '\n') ver++;
+	if(strncmp(ver, "#version", 8) == 0) {
+		const char *endl = strchr(ver, '\n');
+		ver_len = endl ? endl - src + 1 : (int)strlen(src);
+	}
+
+	defs_str = defines_text(defs);
+	if(!(res = malloc(strlen(src) + (defs_str ? strlen(defs_str) : 0) + 1))) {
+		free(defs_str);
+		return 0;
+	}
+	memcpy(res, src, ver_len);
+	sprintf(res + ver_len, "%s%s", defs_str ? defs_str : "", src + ver_len);
+	free(defs_str);
+	return res;
+}
+
+void free_program_variants(void)
+{
+	pthread_mutex_lock(&variants_lock);
+	while(variants) {
+		struct program_variant *pv = variants;
+		variants = variants->next;
+		free_program(pv->prog);
+		free(pv->key);
+		free(pv);
+	}
+	pthread_mutex_unlock(&variants_lock);
+}
+
+#define DEF_DELIM	" \t\r\n,"
+
+/* splits a list of defines into an array of strings. the array and the
+ * strings are allocated in a single block, freed by freeing the array */
+static char **split_defines(const char *defs, int *count)
+{
+	char *buf, *tok, **arr;
+	int len, maxnum, num = 0;
+
+	*count = 0;
+	if(!defs || !*defs) {
+		return 0;
+	}
+	len = strlen(defs);
+	maxnum = len / 2 + 1;
+	if(!(arr = malloc(maxnum * sizeof *arr + len + 1))) {
+		return 0;
+	}
+	buf = (char*)(arr + maxnum);
+	memcpy(buf, defs, len + 1);
+
+	for(tok = strtok(buf, DEF_DELIM); tok; tok = strtok(0, DEF_DELIM)) {
+		arr[num++] = tok;
+	}
+	if(!num) {
+		free(arr);
+		return 0;
+	}
+	*count = num;
+	return arr;
+}
+
+static int strcmp_ptr(const void *a, const void *b)
+{
+	return strcmp(*(const char**)a, *(const char**)b);
+}
+
+/* NAME or NAME=VALUE list to #define lines */
+static char *defines_text(const char *defs)
+{
+	char **arr, *text, *ptr;
+	int i, num, size = 1;
+
+	if(!(arr = split_defines(defs, &num))) {
+		return 0;
+	}
+	for(i=0; i<num; i++) {
+		size += strlen(arr[i]) + 10;	/* "#define " + \n */
+	}
+	if(!(text = malloc(size))) {
+		free(arr);
+		return 0;
+	}
+
+	ptr = text;
+	for(i=0; i<num; i++) {
+		char *eq = strchr(arr[i], '=');
+		if(eq) *eq = ' ';
+		ptr += sprintf(ptr, "#define %s\n", arr[i]);
+	}
+
+	free(arr);
+	return text;
+}
+
+/* the cache key is the kind of program (from files or sources), the file
+ * names or the sources, and the sorted set of defines, so that the same
+ * set in a different order maps to the same program */
+static char *variant_key(char kind, const char *vstr, const char *pstr, const char *defs)
+{
+	char **arr, *key, *ptr;
+	int i, num, size;
+
+	if(!vstr) vstr = "";
+	if(!pstr) pstr = "";
+	size = strlen(vstr) + strlen(pstr) + 5;
+	if(defs) size += strlen(defs);
+
+	if(!(key = malloc(size))) {
+		return 0;
+	}
+	ptr = key + sprintf(key, "%c\n%s\n%s\n", kind, vstr, pstr);
+
+	if((arr = split_defines(defs, &num))) {
+		qsort(arr, num, sizeof *arr, strcmp_ptr);
+		for(i=0; i<num; i++) {
+			ptr += sprintf(ptr, i ? " %s" : "%s", arr[i]);
+		}
+		free(arr);
+	}
+	return key;
+}
+
 /* ---- shader composition ---- */
 struct string {
 	char *text;
 	int len;
 };
 
-#define NUM_SHADER_TYPES	5
+#define NUM_SHADER_TYPES	6
 static struct string header[NUM_SHADER_TYPES];
 static struct string footer[NUM_SHADER_TYPES];
 
@@ -542,6 +1082,10 @@ static const char *sdrtypestr(unsigned int sdrtype)
 	case GL_GEOMETRY_SHADER:
 		return "geometry";
 #endif
+#ifdef GL_COMPUTE_SHADER
+	case GL_COMPUTE_SHADER:
+		return "compute";
+#endif
 
 	default:
 		break;
@@ -562,6 +1106,8 @@ static int sdrtypeidx(unsigned int sdrtype)
 		return 3;
 	case GL_GEOMETRY_SHADER:
 		return 4;
+	case GL_COMPUTE_SHADER:
+		return 5;
 	default:
 		break;
 	}
@@ -18,7 +18,10 @@ unsigned int create_pixel_shader(const char *src);
 unsigned int create_tessctl_shader(const char *src);
 unsigned int create_tesseval_shader(const char *src);
 unsigned int create_geometry_shader(const char *src);
+unsigned int create_compute_shader(const char *src);
 unsigned int create_shader(const char *src, unsigned int sdr_type);
+/* like create_shader, with a list of preprocessor definitions (see below) */
+unsigned int create_shader_defs(const char *src, unsigned int sdr_type, const char *defs);
 void free_shader(unsigned int sdr);
 
 unsigned int load_vertex_shader(const char *fname);
@@ -26,7 +29,9 @@ unsigned int load_pixel_shader(const char *fname);
 unsigned int load_tessctl_shader(const char *fname);
 unsigned int load_tesseval_shader(const char *fname);
 unsigned int load_geometry_shader(const char *fname);
+unsigned int load_compute_shader(const char *fname);
 unsigned int load_shader(const char *src, unsigned int sdr_type);
+unsigned int load_shader_defs(const char *fname, unsigned int sdr_type, const char *defs);
 
 int add_shader(const char *fname, unsigned int sdr);
 int remove_shader(const char *fname);
@@ -35,6 +40,7 @@ int remove_shader(const char *fname);
 unsigned int create_program(void);
 unsigned int create_program_link(unsigned int sdr0, ...);
 unsigned int create_program_load(const char *vfile, const char *pfile);
+unsigned int create_compute_program_load(const char *cfile);
 void free_program(unsigned int sdr);
 
 void attach_shader(unsigned int prog, unsigned int sdr);
@@ -54,6 +60,74 @@ int set_uniform_matrix4_transposed(unsigned int prog, const char *name, const fl
 int get_attrib_loc(unsigned int prog, const char *name);
 void set_attrib_float3(int attr_loc, float x, float y, float z);
 
+/* ---- separable programs ---- */
+
+/* single stage programs, linked with GL_PROGRAM_SEPARABLE, which can be
+ * combined with any other stage program in a pipeline without relinking */
+unsigned int create_stage_program(unsigned int sdr);
+unsigned int load_stage_program(const char *fname, unsigned int sdr_type);
+
+/* returns the pipeline object with the given vertex and pixel stage
+ * programs, creating it the first time. pipeline objects aren't shared
+ * between contexts: ctx is a key for the calling context (its EGLContext,
+ * for instance), and the pipeline is only valid there. the cache is locked
+ * and can be used from any thread */
+unsigned int get_program_pipeline(const void *ctx, unsigned int vprog, unsigned int pprog);
+/* unbinds any program bound with bind_program, which would take precedence */
+int bind_program_pipeline(unsigned int pipeline);
+/* deletes the cached pipelines of ctx, which must be current */
+void free_program_pipelines(const void *ctx);
+
+/* ---- compute ---- */
+
+/* binds the program and dispatches enough work groups to cover a
+ * width x height x depth grid of invocations, according to its local size */
+int dispatch_compute(unsigned int prog, int width, int height, int depth);
+int dispatch_compute_groups(unsigned int prog, int xgroups, int ygroups, int zgroups);
+
+/* ---- program variants ---- */
+
+/* defs is a list of NAME or NAME=VALUE preprocessor definitions, separated
+ * by whitespace or commas, which are inserted after the #version directive.
+ * each distinct set of definitions is compiled and linked once, and cached
+ * for the lifetime of the process. the order of definitions is irrelevant.
+ * the cache is locked, and may be used from any thread with a current
+ * context in the same share group */
+unsigned int get_program_variant(const char *vfile, const char *pfile, const char *defs);
+/* same, from the sources, which are part of the key */
+unsigned int get_program_variant_src(const char *vsrc, const char *psrc, const char *defs);
+/* compile a list of variants upfront, returns the number of failures */
+int warmup_program_variants(const char *vfile, const char *pfile, const char **defs, int count);
+int warmup_program_variants_src(const char *vsrc, const char *psrc, const char **defs, int count);
+/* frees every cached variant: programs from the cache aren't freed one by one */
+void free_program_variants(void);
+/* the source with the #define lines of defs inserted, as the variant
+ * compiles it (without the shader headers and footers). free the result */
+char *shader_source_defs(const char *src, const char *defs);
+
+/* ---- uniform blocks ---- */
+
+/* register a uniform block name with a buffer binding point. every program
+ * linked afterwards which declares a block with that name, gets it bound to
+ * the same binding point, so they all share the same uniform buffer */
+void add_uniform_block(const char *name, unsigned int binding);
+void clear_uniform_blocks(void);
+
+int set_uniform_block_binding(unsigned int prog, const char *name, unsigned int binding);
+/* returns the data size of the named block in bytes, or -1 if not found */
+int get_uniform_block_size(unsigned int prog, const char *name);
+
+/* uniform buffer objects, attached to a binding point on creation.
+ * the buffer is shared with the other contexts of the share group, and so
+ * are the block bindings of the programs, but the buffer binding points are
+ * per context state: only the context current here has the buffer bound.
+ * any other context that draws with it has to bind it to the same point
+ * itself, with glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo) */
+unsigned int create_uniform_buffer(unsigned int binding, int size);
+void free_uniform_buffer(unsigned int ubo);
+/* update (part of) the buffer with a single glBufferSubData */
+int update_uniform_buffer(unsigned int ubo, int offs, int size, const void *data);
+
 /* ---- shader composition ---- */
 
 /* clear shader header/footer text.
@@ -0,0 +1,177 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "memacct.h"
+#include "texpool.h"
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static PooledTexture *pool;
+static TexturePoolStats stats;
+
+static bool
+fence_signaled(GLsync fence)
+{
+    if (!fence)
+        return true;
+
+    GLenum res = glClientWaitSync(fence, 0, 0);
+    return res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED;
+}
+
+PooledTexture *
+tex_acquire(int width, int height, GLenum format, int levels)
+{
+    pthread_mutex_lock(&pool_mutex);
+    PooledTexture **prev = &pool;
+    for (PooledTexture *ptex = pool; ptex; ptex = ptex->next) {
+        if (ptex->width == width && ptex->height == height && ptex->format == format &&
+                ptex->levels == levels && fence_signaled(ptex->fence)) {
+            *prev = ptex->next;
+            stats.reused++;
+            pthread_mutex_unlock(&pool_mutex);
+
+            if (ptex->fence) {
+                glDeleteSync(ptex->fence);
+                ptex->fence = 0;
+            }
+            ptex->next = 0;
+            return ptex;
+        }
+        prev = &ptex->next;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    PooledTexture *ptex = (PooledTexture *)calloc(1, sizeof *ptex);
+    if (!ptex)
+        return 0;
+
+    ptex->width = width;
+    ptex->height = height;
+    ptex->format = format;
+    ptex->levels = levels;
+
+    glGenTextures(1, &ptex->tex);
+    glBindTexture(GL_TEXTURE_2D, ptex->tex);
+    glTexStorage2D(GL_TEXTURE_2D, levels, format, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+            levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    mem_track(MEM_TEXTURE, ptex->tex, mem_texture_size(width, height, format, levels),
+            "pooled texture");
+
+    pthread_mutex_lock(&pool_mutex);
+    stats.created++;
+    if (++stats.live > stats.peak_live)
+        stats.peak_live = stats.live;
+    pthread_mutex_unlock(&pool_mutex);
+    return ptex;
+}
+
+void
+tex_release(PooledTexture *ptex)
+{
+    if (!ptex)
+        return;
+
+    // flush, or other contexts might wait for a fence that's never submitted
+    ptex->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    pthread_mutex_lock(&pool_mutex);
+    ptex->next = pool;
+    pool = ptex;
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+static void
+tex_destroy(PooledTexture *ptex)
+{
+    if (ptex->fence) {
+        glClientWaitSync(ptex->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(ptex->fence);
+    }
+    mem_untrack(MEM_TEXTURE, ptex->tex);
+    glDeleteTextures(1, &ptex->tex);
+    free(ptex);
+
+    pthread_mutex_lock(&pool_mutex);
+    stats.live--;
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+void
+tex_pool_trim()
+{
+    PooledTexture *idle = 0;
+
+    pthread_mutex_lock(&pool_mutex);
+    PooledTexture **prev = &pool;
+    while (*prev) {
+        PooledTexture *ptex = *prev;
+        if (fence_signaled(ptex->fence)) {
+            *prev = ptex->next;
+            ptex->next = idle;
+            idle = ptex;
+        } else {
+            prev = &ptex->next;
+        }
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    while (idle) {
+        PooledTexture *ptex = idle;
+        idle = idle->next;
+        tex_destroy(ptex);
+    }
+}
+
+void
+tex_pool_cleanup()
+{
+    pthread_mutex_lock(&pool_mutex);
+    PooledTexture *list = pool;
+    pool = 0;
+    pthread_mutex_unlock(&pool_mutex);
+
+    while (list) {
+        PooledTexture *ptex = list;
+        list = list->next;
+        tex_destroy(ptex);
+    }
+}
+
+TexturePoolStats
+tex_get_stats()
+{
+    pthread_mutex_lock(&pool_mutex);
+    TexturePoolStats res = stats;
+    pthread_mutex_unlock(&pool_mutex);
+    return res;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#ifndef TEXPOOL_H
+#define TEXPOOL_H
+
+#include <GLES3/gl32.h>
+
+// Textures with immutable storage (glTexStorage2D), recycled through a free
+// list keyed by size, format and number of levels. Textures and fences are
+// shared by all the contexts of the share group, so a texture released by
+// the consumer can be picked up by the producer as soon as the GPU is done
+// with it, without ever respecifying storage.
+struct PooledTexture {
+    GLuint tex;
+    int width, height;
+    int levels;
+    GLenum format;
+
+    // inserted on release, the texture is free to reuse once it's signaled
+    GLsync fence;
+    PooledTexture *next;
+};
+
+struct TexturePoolStats {
+    int created;
+    int reused;
+    int live;
+    int peak_live;
+};
+
+PooledTexture *tex_acquire(int width, int height, GLenum format, int levels);
+// fences the texture in the current context and returns it to the pool
+void tex_release(PooledTexture *ptex);
+// deletes the pooled textures which are no longer in use by the GPU
+void tex_pool_trim();
+// deletes all the pooled textures, waiting for their fences
+void tex_pool_cleanup();
+
+TexturePoolStats tex_get_stats();
+
+#endif //TEXPOOL_H
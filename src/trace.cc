@@ -0,0 +1,562 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sdr.h"
+#include "timer.h"
+#include "trace.h"
+
+#define TRACE_MAGIC "SHCTXTRC"
+#define TRACE_VERSION 1
+
+enum {
+    OP_MAKE_CURRENT,
+    OP_BUFFER,
+    OP_TEXTURE,
+    OP_TEX_SUB_IMAGE,
+    OP_PROGRAM,
+    OP_CLEAR_COLOR,
+    OP_VIEWPORT,
+    OP_SCISSOR,
+    OP_CLEAR,
+    OP_DRAW,
+    OP_SWAP,
+    OP_FINISH,
+
+    NUM_OPS
+};
+
+enum {
+    OBJ_BUFFER,
+    OBJ_TEXTURE,
+    OBJ_PROGRAM,
+
+    NUM_OBJ_TYPES
+};
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t num_surfaces;
+    int32_t width, height;
+};
+
+// followed by nargs 32bit arguments, and the payload padded to 8 bytes
+struct TraceOp {
+    uint16_t op;
+    uint16_t nargs;
+    uint32_t payload_size;
+};
+
+#define MAX_ARGS 8
+
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *trace_fp;
+static bool trace_rec;
+
+// ---- recording ----
+
+bool
+trace_record_start(const char *fname, int num_surfaces, int width, int height)
+{
+    if (!(trace_fp = fopen(fname, "wb"))) {
+        fprintf(stderr, "Failed to open trace %s for writing.\n", fname);
+        return false;
+    }
+
+    TraceHeader hdr;
+    memset(&hdr, 0, sizeof hdr);
+    memcpy(hdr.magic, TRACE_MAGIC, 8);
+    hdr.version = TRACE_VERSION;
+    hdr.num_surfaces = num_surfaces;
+    hdr.width = width;
+    hdr.height = height;
+    fwrite(&hdr, sizeof hdr, 1, trace_fp);
+
+    trace_rec = true;
+    return true;
+}
+
+void
+trace_record_stop()
+{
+    pthread_mutex_lock(&trace_mutex);
+    if (trace_fp) {
+        fclose(trace_fp);
+        trace_fp = 0;
+    }
+    trace_rec = false;
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+bool
+trace_recording()
+{
+    return trace_rec;
+}
+
+static void
+write_op(int op, const int32_t *args, int nargs, const void *payload, long size,
+        const void *payload2 = 0, long size2 = 0)
+{
+    static const char zeros[8] = {0};
+
+    TraceOp hdr;
+    hdr.op = op;
+    hdr.nargs = nargs;
+    hdr.payload_size = size + size2;
+
+    // keep payloads 8 byte aligned in the file, and so in the mapping
+    int pad = (8 - (sizeof hdr + nargs * sizeof *args) % 8) % 8;
+    int tail_pad = (8 - hdr.payload_size % 8) % 8;
+
+    pthread_mutex_lock(&trace_mutex);
+    if (trace_fp) {
+        fwrite(&hdr, sizeof hdr, 1, trace_fp);
+        fwrite(args, sizeof *args, nargs, trace_fp);
+        fwrite(zeros, 1, pad, trace_fp);
+        if (size)
+            fwrite(payload, 1, size, trace_fp);
+        if (size2)
+            fwrite(payload2, 1, size2, trace_fp);
+        fwrite(zeros, 1, tail_pad, trace_fp);
+    }
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+void
+trace_make_current(int ctx, int surf)
+{
+    if (!trace_rec)
+        return;
+    int32_t args[] = {ctx, surf};
+    write_op(OP_MAKE_CURRENT, args, 2, 0, 0);
+}
+
+void
+trace_buffer(GLuint buf, const void *data, long size)
+{
+    if (!trace_rec)
+        return;
+    int32_t args[] = {(int32_t)buf};
+    write_op(OP_BUFFER, args, 1, data, size);
+}
+
+void
+trace_texture(GLuint tex, int width, int height, GLenum format, int levels)
+{
+    if (!trace_rec)
+        return;
+    int32_t args[] = {(int32_t)tex, width, height, (int32_t)format, levels};
+    write_op(OP_TEXTURE, args, 5, 0, 0);
+}
+
+void
+trace_tex_sub_image(GLuint tex, int x, int y, int width, int height, const void *pixels)
+{
+    if (!trace_rec)
+        return;
+    int32_t args[] = {(int32_t)tex, x, y, width, height};
+    write_op(OP_TEX_SUB_IMAGE, args, 5, pixels, (long)width * height * 4);
+}
+
+void
+trace_program(GLuint prog, const char *vsrc, const char *psrc)
+{
+    if (!trace_rec)
+        return;
+
+    // the sources go in the trace, with their terminators
+    long vsize = strlen(vsrc) + 1;
+    long psize = strlen(psrc) + 1;
+    int32_t args[] = {(int32_t)prog, (int32_t)vsize};
+    write_op(OP_PROGRAM, args, 2, vsrc, vsize, psrc, psize);
+}
+
+void
+trace_clear_color(float r, float g, float b, float a)
+{
+    if (!trace_rec)
+        return;
+    float col[] = {r, g, b, a};
+    int32_t args[4];
+    memcpy(args, col, sizeof args);
+    write_op(OP_CLEAR_COLOR, args, 4, 0, 0);
+}
+
+void
+trace_viewport(int x, int y, int width, int height)
+{
+    if (!trace_rec)
+        return;
+    int32_t args[] = {x, y, width, height};
+    write_op(OP_VIEWPORT, args, 4, 0, 0);
+}
+
+void
+trace_scissor(bool enable, int x, int y, int width, int height)
+{
+    if (!trace_rec)
+        return;
+    int32_t args[] = {enable, x, y, width, height};
+    write_op(OP_SCISSOR, args, 5, 0, 0);
+}
+
+void
+trace_clear(GLbitfield mask)
+{
+    if (!trace_rec)
+        return;
+    int32_t args[] = {(int32_t)mask};
+    write_op(OP_CLEAR, args, 1, 0, 0);
+}
+
+void
+trace_draw(GLuint prog, GLuint tex, GLuint vbo, GLenum mode, int count)
+{
+    if (!trace_rec)
+        return;
+    int32_t args[] = {(int32_t)prog, (int32_t)tex, (int32_t)vbo, (int32_t)mode, count};
+    write_op(OP_DRAW, args, 5, 0, 0);
+}
+
+void
+trace_swap(int surf)
+{
+    if (!trace_rec)
+        return;
+    int32_t args[] = {surf};
+    write_op(OP_SWAP, args, 1, 0, 0);
+}
+
+void
+trace_finish()
+{
+    if (!trace_rec)
+        return;
+    write_op(OP_FINISH, 0, 0, 0, 0);
+}
+
+// ---- replay ----
+
+// recorded object names to replayed ones
+struct ObjMap {
+    GLuint *names;
+    int size;
+};
+
+// recorded names are the ones GL generated, far below this
+#define MAX_OBJ_NAME (1 << 20)
+
+static GLuint *
+obj_slot(ObjMap *map, GLuint name)
+{
+    if (name >= MAX_OBJ_NAME)
+        return 0;
+    if ((int)name >= map->size) {
+        int nsize = name * 2 + 16;
+        GLuint *tmp = (GLuint *)realloc(map->names, nsize * sizeof *tmp);
+        if (!tmp)
+            return 0;
+        memset(tmp + map->size, 0, (nsize - map->size) * sizeof *tmp);
+        map->names = tmp;
+        map->size = nsize;
+    }
+    return map->names + name;
+}
+
+static GLuint
+obj_get(ObjMap *map, GLuint name)
+{
+    return name < MAX_OBJ_NAME && (int)name < map->size ? map->names[name] : 0;
+}
+
+static bool
+name_ok(int32_t name)
+{
+    return name >= 0 && name < MAX_OBJ_NAME;
+}
+
+/* nothing read from the file is used as an index or a size before it's
+ * checked here. ops which interpret their payload must fit in it: a
+ * truncated texture upload or an unterminated shader source would read
+ * past the op into the next one.
+ */
+static bool
+op_valid(const TraceOp *hdr, const int32_t *args, const char *payload)
+{
+    switch (hdr->op) {
+    case OP_MAKE_CURRENT:
+        return args[0] >= 0 && args[0] < TRACE_NUM_CTX;
+
+    case OP_BUFFER:
+    case OP_TEXTURE:
+        return name_ok(args[0]);
+
+    case OP_TEX_SUB_IMAGE:
+        return name_ok(args[0]) && args[3] >= 0 && args[4] >= 0 &&
+            (uint64_t)args[3] * args[4] * 4 <= hdr->payload_size;
+
+    case OP_PROGRAM:
+        return name_ok(args[0]) && args[1] > 0 && (uint32_t)args[1] < hdr->payload_size &&
+            memchr(payload, 0, args[1]) &&
+            memchr(payload + args[1], 0, hdr->payload_size - args[1]);
+
+    case OP_DRAW:
+        return name_ok(args[0]) && name_ok(args[1]) && name_ok(args[2]) && args[4] >= 0;
+
+    default:
+        break;
+    }
+    return true;
+}
+
+bool
+trace_read_header(const char *fname, int *num_surfaces, int *width, int *height)
+{
+    FILE *fp = fopen(fname, "rb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open trace %s.\n", fname);
+        return false;
+    }
+
+    TraceHeader hdr;
+    bool res = fread(&hdr, sizeof hdr, 1, fp) == 1 &&
+        memcmp(hdr.magic, TRACE_MAGIC, 8) == 0 && hdr.version == TRACE_VERSION;
+    fclose(fp);
+
+    if (!res) {
+        fprintf(stderr, "%s is not a shctx trace (version %d).\n", fname, TRACE_VERSION);
+        return false;
+    }
+    *num_surfaces = hdr.num_surfaces;
+    *width = hdr.width;
+    *height = hdr.height;
+    return true;
+}
+
+bool
+trace_replay(const char *fname, EGLDisplay dpy, const EGLContext *ctx,
+        const EGLSurface *surfs, int num_surfs, TraceStats *stats)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Failed to open trace %s.\n", fname);
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    void *mem = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "Failed to map trace %s.\n", fname);
+        return false;
+    }
+
+    const char *ptr = (const char *)mem + sizeof(TraceHeader);
+    const char *end = (const char *)mem + st.st_size;
+    ObjMap objects[NUM_OBJ_TYPES];
+    memset(objects, 0, sizeof objects);
+    memset(stats, 0, sizeof *stats);
+    bool res = true;
+
+    long t = get_time_usec();
+
+    while (res && ptr + sizeof(TraceOp) <= end) {
+        TraceOp hdr;
+        memcpy(&hdr, ptr, sizeof hdr);
+
+        int32_t args[MAX_ARGS] = {0};
+        int args_size = hdr.nargs * sizeof(int32_t);
+        int pad = (8 - (sizeof hdr + args_size) % 8) % 8;
+        const char *payload = ptr + sizeof hdr + args_size + pad;
+        const char *next = payload + hdr.payload_size + (8 - hdr.payload_size % 8) % 8;
+
+        if (hdr.nargs > MAX_ARGS || hdr.op >= NUM_OPS || next > end) {
+            fprintf(stderr, "Corrupt trace at offset %ld.\n", (long)(ptr - (const char *)mem));
+            res = false;
+            break;
+        }
+        memcpy(args, ptr + sizeof hdr, args_size);
+        if (!op_valid(&hdr, args, payload)) {
+            fprintf(stderr, "Corrupt trace at offset %ld.\n", (long)(ptr - (const char *)mem));
+            res = false;
+            break;
+        }
+        stats->payload_bytes += hdr.payload_size;
+        stats->ops++;
+
+        switch (hdr.op) {
+        case OP_MAKE_CURRENT:
+            {
+                EGLSurface surf = args[1] >= 0 && args[1] < num_surfs ?
+                    surfs[args[1]] : EGL_NO_SURFACE;
+                if (!eglMakeCurrent(dpy, surf, surf, ctx[args[0]])) {
+                    // no surfaceless contexts: any surface will do
+                    eglMakeCurrent(dpy, surfs[0], surfs[0], ctx[args[0]]);
+                }
+            }
+            break;
+
+        case OP_BUFFER:
+            {
+                GLuint *buf = obj_slot(&objects[OBJ_BUFFER], args[0]);
+                if (!buf) {
+                    res = false;
+                    break;
+                }
+                // a name may be recorded again once the pool recycled it
+                if (*buf)
+                    glDeleteBuffers(1, buf);
+                glGenBuffers(1, buf);
+                glBindBuffer(GL_ARRAY_BUFFER, *buf);
+                glBufferData(GL_ARRAY_BUFFER, hdr.payload_size, payload, GL_STATIC_DRAW);
+            }
+            break;
+
+        case OP_TEXTURE:
+            {
+                // same as tex_acquire
+                GLuint *tex = obj_slot(&objects[OBJ_TEXTURE], args[0]);
+                if (!tex) {
+                    res = false;
+                    break;
+                }
+                if (*tex)
+                    glDeleteTextures(1, tex);
+                glGenTextures(1, tex);
+                glBindTexture(GL_TEXTURE_2D, *tex);
+                glTexStorage2D(GL_TEXTURE_2D, args[4], args[3], args[1], args[2]);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        args[4] > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, args[4] - 1);
+            }
+            break;
+
+        case OP_TEX_SUB_IMAGE:
+            glBindTexture(GL_TEXTURE_2D, obj_get(&objects[OBJ_TEXTURE], args[0]));
+            glTexSubImage2D(GL_TEXTURE_2D, 0, args[1], args[2], args[3], args[4],
+                    GL_RGBA, GL_UNSIGNED_BYTE, payload);
+            break;
+
+        case OP_PROGRAM:
+            {
+                // both sources are null terminated
+                unsigned int vs = create_vertex_shader(payload);
+                unsigned int ps = create_pixel_shader(payload + args[1]);
+                GLuint *prog = obj_slot(&objects[OBJ_PROGRAM], args[0]);
+                if (prog && *prog)
+                    free_program(*prog);
+                if (prog)
+                    *prog = create_program_link(vs, ps, 0);
+                free_shader(vs);
+                free_shader(ps);
+                if (!prog || !*prog)
+                    res = false;
+            }
+            break;
+
+        case OP_CLEAR_COLOR:
+            {
+                float col[4];
+                memcpy(col, args, sizeof col);
+                glClearColor(col[0], col[1], col[2], col[3]);
+            }
+            break;
+
+        case OP_VIEWPORT:
+            glViewport(args[0], args[1], args[2], args[3]);
+            break;
+
+        case OP_SCISSOR:
+            if (args[0]) {
+                glEnable(GL_SCISSOR_TEST);
+                glScissor(args[1], args[2], args[3], args[4]);
+            } else {
+                glDisable(GL_SCISSOR_TEST);
+            }
+            break;
+
+        case OP_CLEAR:
+            glClear(args[0]);
+            break;
+
+        case OP_DRAW:
+            glUseProgram(obj_get(&objects[OBJ_PROGRAM], args[0]));
+            glBindTexture(GL_TEXTURE_2D, obj_get(&objects[OBJ_TEXTURE], args[1]));
+            glBindBuffer(GL_ARRAY_BUFFER, obj_get(&objects[OBJ_BUFFER], args[2]));
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+            glEnableVertexAttribArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glDrawArrays(args[3], 0, args[4]);
+            break;
+
+        case OP_SWAP:
+            if (args[0] >= 0 && args[0] < num_surfs)
+                eglSwapBuffers(dpy, surfs[args[0]]);
+            stats->frames++;
+            break;
+
+        case OP_FINISH:
+            glFinish();
+            break;
+        }
+        ptr = next;
+    }
+    glFinish();
+    stats->usec = get_time_usec() - t;
+
+    // everything was created in the same share group
+    for (int i = 0; i < objects[OBJ_PROGRAM].size; i++) {
+        if (objects[OBJ_PROGRAM].names[i])
+            free_program(objects[OBJ_PROGRAM].names[i]);
+    }
+    for (int i = 0; i < objects[OBJ_TEXTURE].size; i++) {
+        if (objects[OBJ_TEXTURE].names[i])
+            glDeleteTextures(1, &objects[OBJ_TEXTURE].names[i]);
+    }
+    for (int i = 0; i < objects[OBJ_BUFFER].size; i++) {
+        if (objects[OBJ_BUFFER].names[i])
+            glDeleteBuffers(1, &objects[OBJ_BUFFER].names[i]);
+    }
+    for (int i = 0; i < NUM_OBJ_TYPES; i++) {
+        free(objects[i].names);
+    }
+    eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+    munmap(mem, st.st_size);
+    return res;
+}
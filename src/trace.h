@@ -0,0 +1,83 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <EGL/egl.h>
+#include <GLES3/gl32.h>
+
+// Recording of the GL/EGL work shctx issues, with the buffer and texture
+// payloads, to a compact binary file, and its deterministic replay. Objects
+// are recorded with the names they had, and mapped to new ones on replay.
+// Payloads are read straight from the memory mapped file.
+//
+// Calls are recorded at the level of the shctx helpers: a texture is its
+// immutable storage plus the pool's sampling parameters, a draw is the
+// textured quad with its program, texture and vertex buffer.
+
+enum {
+    TRACE_CTX_CONSUMER,
+    TRACE_CTX_PRODUCER,
+
+    TRACE_NUM_CTX
+};
+
+// no surface bound, for surfaceless make current
+#define TRACE_NO_SURFACE -1
+
+bool trace_record_start(const char *fname, int num_surfaces, int width, int height);
+void trace_record_stop();
+bool trace_recording();
+
+// all of these do nothing unless recording
+void trace_make_current(int ctx, int surf);
+void trace_buffer(GLuint buf, const void *data, long size);
+void trace_texture(GLuint tex, int width, int height, GLenum format, int levels);
+// level 0, RGBA/UNSIGNED_BYTE pixels
+void trace_tex_sub_image(GLuint tex, int x, int y, int width, int height, const void *pixels);
+void trace_program(GLuint prog, const char *vsrc, const char *psrc);
+void trace_clear_color(float r, float g, float b, float a);
+void trace_viewport(int x, int y, int width, int height);
+void trace_scissor(bool enable, int x, int y, int width, int height);
+void trace_clear(GLbitfield mask);
+void trace_draw(GLuint prog, GLuint tex, GLuint vbo, GLenum mode, int count);
+void trace_swap(int surf);
+void trace_finish();
+
+struct TraceStats {
+    int ops;
+    int frames;
+    long payload_bytes;
+    long usec;
+};
+
+bool trace_read_header(const char *fname, int *num_surfaces, int *width, int *height);
+// surfs are indexed by the recorded surface numbers, ctx by TRACE_CTX_*
+bool trace_replay(const char *fname, EGLDisplay dpy, const EGLContext *ctx,
+        const EGLSurface *surfs, int num_surfs, TraceStats *stats);
+
+#endif //TRACE_H
@@ -0,0 +1,140 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#include <stdlib.h>
+
+#include "timer.h"
+#include "upload.h"
+
+static Rect
+tile_rect(const TileUpload *up, int idx)
+{
+    int x = idx % up->tiles_x * UPLOAD_TILE_SIZE;
+    int y = idx / up->tiles_x * UPLOAD_TILE_SIZE;
+    Rect r = {x, y, up->ptex->width - x, up->ptex->height - y};
+    if (r.width > UPLOAD_TILE_SIZE)
+        r.width = UPLOAD_TILE_SIZE;
+    if (r.height > UPLOAD_TILE_SIZE)
+        r.height = UPLOAD_TILE_SIZE;
+    return r;
+}
+
+TileUpload *
+upload_start(PooledTexture *ptex, const void *pixels)
+{
+    TileUpload *up = (TileUpload *)calloc(1, sizeof *up);
+    if (!up)
+        return 0;
+
+    up->ptex = ptex;
+    up->pixels = (const unsigned char *)pixels;
+    up->tiles_x = (ptex->width + UPLOAD_TILE_SIZE - 1) / UPLOAD_TILE_SIZE;
+    up->tiles_y = (ptex->height + UPLOAD_TILE_SIZE - 1) / UPLOAD_TILE_SIZE;
+    up->num_tiles = up->tiles_x * up->tiles_y;
+
+    if (!(up->order = (int *)malloc(up->num_tiles * sizeof *up->order))) {
+        free(up);
+        return 0;
+    }
+    for (int i = 0; i < up->num_tiles; i++) {
+        up->order[i] = i;
+    }
+    return up;
+}
+
+void
+upload_free(TileUpload *up)
+{
+    if (!up)
+        return;
+    free(up->order);
+    free(up);
+}
+
+void
+upload_prioritize(TileUpload *up, const Rect &r)
+{
+    if (rect_empty(r))
+        return;
+
+    // stable partition of the pending tiles, keeps the row order otherwise
+    int *tmp = (int *)malloc((up->num_tiles - up->next) * sizeof *tmp);
+    if (!tmp)
+        return;
+
+    int n = up->next;
+    int count = 0;
+    for (int i = up->next; i < up->num_tiles; i++) {
+        if (rect_empty(rect_intersect(tile_rect(up, up->order[i]), r))) {
+            tmp[count++] = up->order[i];
+        } else {
+            up->order[n++] = up->order[i];
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        up->order[n++] = tmp[i];
+    }
+    free(tmp);
+}
+
+bool
+upload_step(TileUpload *up, long max_bytes, long max_usec)
+{
+    if (upload_done(up))
+        return true;
+
+    long start = get_time_usec();
+    long bytes = 0;
+
+    glBindTexture(GL_TEXTURE_2D, up->ptex->tex);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, up->ptex->width);
+    while (up->next < up->num_tiles) {
+        Rect r = tile_rect(up, up->order[up->next++]);
+        const unsigned char *src = up->pixels + ((long)r.y * up->ptex->width + r.x) * 4;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height,
+                GL_RGBA, GL_UNSIGNED_BYTE, src);
+        bytes += (long)r.width * r.height * 4;
+
+        if ((max_bytes && bytes >= max_bytes) ||
+                (max_usec && get_time_usec() - start >= max_usec))
+            break;
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    long usec = get_time_usec() - start;
+    if (usec > up->max_step_usec)
+        up->max_step_usec = usec;
+    up->usec += usec;
+    up->bytes += bytes;
+    up->frames++;
+    return upload_done(up);
+}
+
+bool
+upload_done(const TileUpload *up)
+{
+    return up->next == up->num_tiles;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include "damage.h"
+#include "texpool.h"
+
+// Incremental upload of a big RGBA image into a texture, a few tiles per
+// frame, so that loading it never costs one frame more than the budget.
+// Tiles are uploaded with glTexSubImage2D straight from the source image.
+#define UPLOAD_TILE_SIZE 256
+
+struct TileUpload {
+    PooledTexture *ptex;
+    const unsigned char *pixels;
+    int tiles_x, tiles_y;
+
+    // tile indices in upload order, the first next are done
+    int *order;
+    int next;
+    int num_tiles;
+
+    int frames;
+    long bytes;
+    long usec;
+    long max_step_usec;
+};
+
+// pixels must stay around until the upload is complete
+TileUpload *upload_start(PooledTexture *ptex, const void *pixels);
+void upload_free(TileUpload *up);
+
+// moves the pending tiles that intersect r (in texture coordinates) first
+void upload_prioritize(TileUpload *up, const Rect &r);
+
+// Uploads tiles until max_bytes or max_usec is exceeded, at least one per
+// call, zero means no limit. The time is what the glTexSubImage2D calls
+// take to return, not the transfer itself. Returns true once the texture
+// is complete.
+bool upload_step(TileUpload *up, long max_bytes, long max_usec);
+bool upload_done(const TileUpload *up);
+
+#endif //UPLOAD_H
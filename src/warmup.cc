@@ -0,0 +1,171 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#include "rtpool.h"
+#include "sdr.h"
+#include "texpool.h"
+#include "timer.h"
+#include "warmup.h"
+
+struct WarmupProgram {
+    const char *name;
+    unsigned int prog;
+    WarmupState state;
+    bool done;
+    long usec;
+};
+
+static WarmupProgram programs[MAX_WARMUP_PROGRAMS];
+static int num_programs;
+static long total_usec;
+
+bool
+warmup_register(const char *name, unsigned int prog, const WarmupState &st)
+{
+    if (num_programs >= MAX_WARMUP_PROGRAMS) {
+        fprintf(stderr, "Too many programs to warm up, skipping %s.\n", name);
+        return false;
+    }
+
+    WarmupProgram *wp = programs + num_programs++;
+    wp->name = name;
+    wp->prog = prog;
+    wp->state = st;
+    wp->done = false;
+    wp->usec = 0;
+    return true;
+}
+
+void
+warmup_clear()
+{
+    num_programs = 0;
+}
+
+static void
+warmup_draw(WarmupProgram *wp, GLuint vbo)
+{
+    const WarmupState &st = wp->state;
+    long t = get_time_usec();
+
+    // a few pixels are enough, in the format the program renders to
+    RenderTarget *rt = rt_acquire(16, 16, st.target_format, 0);
+    PooledTexture *ptex = st.tex_format ? tex_acquire(4, 4, st.tex_format, 1) : 0;
+    if (!rt || (st.tex_format && !ptex)) {
+        fprintf(stderr, "Failed to create the warm-up target of %s.\n", wp->name);
+        rt_release(rt);
+        tex_release(ptex);
+        return;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, rt->fbo);
+    glViewport(0, 0, 16, 16);
+    if (st.blend) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+    bind_program(wp->prog);
+    if (ptex)
+        glBindTexture(GL_TEXTURE_2D, ptex->tex);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glVertexAttribPointer(st.attrib, st.attrib_size, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(st.attrib);
+
+    glDrawArrays(st.primitive, 0, 4);
+    glFinish();
+
+    glDisableVertexAttribArray(st.attrib);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    bind_program(0);
+    glDisable(GL_BLEND);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    rt_release(rt);
+    tex_release(ptex);
+
+    wp->usec = get_time_usec() - t;
+    wp->done = true;
+}
+
+void
+warmup_run()
+{
+    long t = get_time_usec();
+    GLuint vbo = 0;
+
+    for (int i = 0; i < num_programs; i++) {
+        WarmupProgram *wp = programs + i;
+        if (wp->done)
+            continue;
+
+        // a unit quad, in the vertex layout of the program
+        static const float quad[] = {1, 1, 1, 0, 0, 1, 0, 0};
+        float vertices[4 * 4] = {0};
+        int size = wp->state.attrib_size;
+        if (size < 1 || size > 4) {
+            fprintf(stderr, "Invalid vertex layout for %s.\n", wp->name);
+            continue;
+        }
+        for (int j = 0; j < 4; j++) {
+            for (int k = 0; k < size && k < 2; k++) {
+                vertices[j * size + k] = quad[j * 2 + k];
+            }
+        }
+
+        if (!vbo)
+            glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, 4 * size * sizeof *vertices, vertices, GL_STATIC_DRAW);
+
+        warmup_draw(wp, vbo);
+    }
+
+    if (vbo) {
+        glDeleteBuffers(1, &vbo);
+        // the targets are only used here, don't keep them in the pool
+        rt_collect(0);
+    }
+    total_usec += get_time_usec() - t;
+}
+
+void
+warmup_print_stats(FILE *fp)
+{
+    bool header = false;
+
+    for (int i = 0; i < num_programs; i++) {
+        if (!programs[i].done)
+            continue;
+        if (!header) {
+            fprintf(fp, "program warm-up:\n");
+            header = true;
+        }
+        fprintf(fp, "  %-20s %8.3f ms\n", programs[i].name, programs[i].usec / 1000.0);
+    }
+    if (header)
+        fprintf(fp, "  %-20s %8.3f ms\n", "total", total_usec / 1000.0);
+}
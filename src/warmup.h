@@ -0,0 +1,58 @@
+/*
+ * Copyright © 2021 Igalia S.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Author:
+ *    Eleni Maria Stea <estea@igalia.com>
+ */
+
+#ifndef WARMUP_H
+#define WARMUP_H
+
+#include <stdio.h>
+#include <GLES3/gl32.h>
+
+// Drivers often compile the real code of a program on its first draw, for
+// the state it's drawn with, rather than on link. Programs registered here
+// get a tiny draw with that state on an offscreen target, before the first
+// frame needs them.
+struct WarmupState {
+    bool blend;
+    GLenum tex_format;      // of the texture on unit 0, 0 for none
+    GLuint attrib;          // vertex layout: a float attribute
+    int attrib_size;
+    GLenum primitive;
+    GLenum target_format;
+};
+
+#define MAX_WARMUP_PROGRAMS 16
+
+bool warmup_register(const char *name, unsigned int prog, const WarmupState &st);
+// forgets all the programs, before they are deleted
+void warmup_clear();
+
+// Draws with each program registered since the last run, in the current
+// context, waiting for every draw to finish. The stats have the time of
+// each program, and the total of all the runs.
+void warmup_run();
+void warmup_print_stats(FILE *fp);
+
+#endif //WARMUP_H
@@ -0,0 +1,198 @@
+# Embeds GLSL shaders in a C++ header, with typed handles for their vertex
+# attributes and uniforms:
+#
+#   awk -f tools/embed_shaders.awk data/*.vert data/*.frag > src/shaders.h
+#
+# Every file becomes a shaders::<name>_<ext> EmbeddedShader. Attributes
+# declared with an explicit location become shaders::attrib::<name>, and
+# the uniforms of all the files share a table of slots, with one
+# shaders::uniform::<name> UniformSlot per distinct uniform name. A name
+# declared with two different types in two files is an error. Declarations
+# may list several names, but must fit on one line; array uniforms are
+# listed as skipped in the header.
+
+function cname(path,    n) {
+    n = path
+    sub(/^.*\//, "", n)
+    gsub(/[^A-Za-z0-9_]/, "_", n)
+    return n
+}
+
+function stage(path) {
+    if (path ~ /\.vert$/) return "GL_VERTEX_SHADER"
+    if (path ~ /\.frag$/) return "GL_FRAGMENT_SHADER"
+    if (path ~ /\.comp$/) return "GL_COMPUTE_SHADER"
+    return ""
+}
+
+function slot_type(t) {
+    if (t == "float") return "float"
+    if (t == "int" || t == "bool") return "int"
+    if (t == "uint") return "unsigned int"
+    if (t == "vec2") return "Vec2"
+    if (t == "vec3") return "Vec3"
+    if (t == "vec4") return "Vec4"
+    if (t == "mat3") return "Mat3"
+    if (t == "mat4") return "Mat4"
+    if (t ~ /^[iu]?sampler/) return "Sampler"
+    if (t ~ /^[iu]?image/) return "Image"
+    return ""
+}
+
+function fail(msg) {
+    printf("%s:%d: %s\n", FILENAME, FNR, msg) > "/dev/stderr"
+    failed = 1
+    exit 1
+}
+
+function escape(s) {
+    gsub(/\\/, "\\\\", s)
+    gsub(/"/, "\\\"", s)
+    gsub(/\t/, "\\t", s)
+    return s
+}
+
+# the type and names of "[layout(...)] [qualifiers] <keyword> [precision]
+# type name[, name...];", in decl_type, decl_names[1..decl_count]. array
+# sizes stay in the names, as in "a[4]"
+function parse_decl(line, keyword,    n, tok, i, names) {
+    sub(/\/\/.*$/, "", line)
+    gsub(/layout[ \t]*\([^)]*\)/, "", line)
+    if (line !~ /;/)
+        fail(keyword " declarations must end on the line they start")
+    sub(/;.*$/, "", line)
+    gsub(/[ \t]*\[[ \t]*/, "[", line)
+    gsub(/[ \t]*\]/, "]", line)
+    gsub(/[ \t]*,[ \t]*/, ",", line)
+    n = split(line, tok, /[ \t]+/)
+    for (i = 1; i <= n && tok[i] != keyword; i++)
+        ;
+    for (i++; i <= n && tok[i] ~ /^(lowp|mediump|highp|flat|smooth)$/; i++)
+        ;
+    decl_type = tok[i]
+    names = ""
+    for (i++; i <= n; i++)
+        names = names tok[i]
+    decl_count = split(names, decl_names, /,/)
+    if (!decl_type || !decl_count)
+        fail("can't parse the " keyword " declaration")
+    for (i = 1; i <= decl_count; i++) {
+        if (decl_names[i] !~ /^[A-Za-z_][A-Za-z0-9_]*(\[[^]]*\])*$/)
+            fail("can't parse the " keyword " declaration of \"" decl_names[i] "\"")
+    }
+}
+
+FNR == 1 {
+    if (!stage(FILENAME))
+        fail("unknown shader stage")
+    files[++nfiles] = FILENAME
+}
+
+{
+    src[nfiles] = src[nfiles] "\n    \"" escape($0) "\\n\""
+}
+
+/^[ \t]*layout[ \t]*\([ \t]*location[ \t]*=[ \t]*[0-9]+[ \t]*\)[ \t]*in[ \t]/ && FILENAME ~ /\.vert$/ {
+    loc = $0
+    sub(/^[^=]*=[ \t]*/, "", loc)
+    sub(/[^0-9].*$/, "", loc)
+    parse_decl($0, "in")
+    if (decl_count > 1)
+        fail("one attribute per declaration with an explicit location")
+    decl_name = decl_names[1]
+    if (decl_name in attr_loc && attr_loc[decl_name] != loc)
+        fail("attribute " decl_name " has two different locations")
+    if (!(decl_name in attr_loc))
+        attrs[++nattrs] = decl_name
+    attr_loc[decl_name] = loc
+    attr_info[decl_name] = FILENAME ": " decl_type
+}
+
+/(^|[ \t])uniform[ \t]/ && !/\{/ {
+    parse_decl($0, "uniform")
+    t = slot_type(decl_type)
+    for (d = 1; d <= decl_count; d++) {
+        decl_name = decl_names[d]
+        if (decl_name ~ /\[/ || decl_type ~ /\[/) {
+            skipped[++nskipped] = FILENAME ": " decl_type " " decl_name " (arrays aren't supported)"
+            continue
+        }
+        if (!t) {
+            skipped[++nskipped] = FILENAME ": " decl_type " " decl_name " (unsupported type)"
+            continue
+        }
+        if (decl_name in uni_type && uni_type[decl_name] != t)
+            fail("uniform " decl_name " declared as " uni_glsl[decl_name] " elsewhere")
+        if (!(decl_name in uni_type)) {
+            unis[++nunis] = decl_name
+            uni_type[decl_name] = t
+            uni_glsl[decl_name] = decl_type
+            uni_info[decl_name] = FILENAME ": " decl_type
+        }
+    }
+}
+
+END {
+    if (failed)
+        exit 1
+
+    print "// Generated by tools/embed_shaders.awk from the shaders in data/, don't edit."
+    print ""
+    print "#ifndef SHADERS_H"
+    print "#define SHADERS_H"
+    print ""
+    print "#include <GLES3/gl32.h>"
+    print ""
+    print "#include \"embed.h\""
+    print ""
+    print "namespace shaders {"
+    print ""
+    for (i = 1; i <= nfiles; i++) {
+        printf("constexpr EmbeddedShader %s = {\"%s\", %s,%s};\n\n",
+                cname(files[i]), files[i], stage(files[i]), src[i])
+    }
+
+    print "// vertex attributes with an explicit location"
+    print "namespace attrib {"
+    for (i = 1; i <= nattrs; i++) {
+        printf("constexpr int %s = %d;    // %s\n", attrs[i], attr_loc[attrs[i]], attr_info[attrs[i]])
+    }
+    print "}"
+    print ""
+
+    print "// the uniforms of all the shaders, by slot"
+    print "namespace uniform {"
+    for (i = 1; i <= nunis; i++) {
+        printf("constexpr UniformSlot<%s> %s = {%d};    // %s\n", uni_type[unis[i]], unis[i],
+                i - 1, uni_info[unis[i]])
+    }
+    for (i = 1; i <= nskipped; i++) {
+        printf("// skipped: %s\n", skipped[i])
+    }
+    print "}"
+    print ""
+
+    printf("constexpr int num_uniforms = %d;\n", nunis)
+    if (nunis) {
+        printf("constexpr const char *uniform_names[num_uniforms] = {")
+        for (i = 1; i <= nunis; i++) {
+            printf("%s\"%s\"", i > 1 ? ", " : "", unis[i])
+        }
+        print "};"
+    } else {
+        print "constexpr const char *const *uniform_names = 0;"
+    }
+    print ""
+    print "typedef UniformTable<num_uniforms> Uniforms;"
+    print ""
+    print "// looks up the location of every uniform slot in prog, once"
+    print "inline void"
+    print "get_uniforms(unsigned int prog, Uniforms *uni)"
+    print "{"
+    print "    get_uniform_locations(prog, uniform_names, num_uniforms, uni->loc);"
+    print "}"
+    print ""
+    print "}"
+    print ""
+    print "#endif //SHADERS_H"
+}